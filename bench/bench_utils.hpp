@@ -0,0 +1,645 @@
+#ifndef BENCH_UTILS_H  // Reduce colisions risk with prefix bench_
+#define BENCH_UTILS_H
+
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <job_scheduler.hpp>
+
+
+using Clock = std::chrono::steady_clock;
+using Frame = std::vector<char>;
+
+
+/** Active wait (simulate a CPU bound job of the given duration)
+  */
+inline void busyWait(std::chrono::nanoseconds duration)
+{
+    if (duration.count() <= 0)
+    {
+        return;
+    }
+    auto end = Clock::now() + duration;
+    while (Clock::now() < end)
+    {
+    }
+}
+
+
+inline double toMicroseconds(Clock::duration duration)
+{
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+
+/** Distribution of the job service times
+  */
+enum class ServiceDistribution
+{
+    FIXED,  // Always the mean
+    EXPONENTIAL,
+    HEAVY_TAILED  // Pareto (alpha=1.5), truncated at 100x the mean
+};
+
+
+inline std::string toString(ServiceDistribution distribution)
+{
+    switch (distribution)
+    {
+        case ServiceDistribution::FIXED: return "fixed";
+        case ServiceDistribution::EXPONENTIAL: return "exponential";
+        case ServiceDistribution::HEAVY_TAILED: return "heavy_tailed";
+    }
+    return "unknown";
+}
+
+
+/** Generate the service time of each job (deterministic for a given seed)
+  */
+class ServiceTimeGenerator
+{
+public:
+    ServiceTimeGenerator(ServiceDistribution distribution, double meanUs, unsigned seed = 42) :
+        _distribution(distribution),
+        _meanUs(meanUs),
+        _engine(seed)
+    {}
+
+    std::chrono::nanoseconds next()
+    {
+        double us = _meanUs;
+        if (_distribution == ServiceDistribution::EXPONENTIAL && _meanUs > 0)
+        {
+            us = std::exponential_distribution<double>(1.0 / _meanUs)(_engine);
+        }
+        else if (_distribution == ServiceDistribution::HEAVY_TAILED && _meanUs > 0)
+        {
+            const double alpha = 1.5;
+            const double scale = _meanUs * (alpha - 1.0) / alpha;  // Mean of the Pareto distribution is _meanUs
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(_engine);
+            us = std::min(scale / std::pow(1.0 - u, 1.0 / alpha), 100.0 * _meanUs);
+        }
+        return std::chrono::nanoseconds(static_cast<long long>(us * 1000.0));
+    }
+
+private:
+    ServiceDistribution _distribution;
+    double _meanUs;
+    std::mt19937 _engine;
+};
+
+
+/** Collect latency samples and compute the percentiles
+  */
+class LatencyRecorder
+{
+public:
+    void reserve(size_t nbSamples)
+    {
+        _samplesUs.reserve(nbSamples);
+    }
+
+    void add(Clock::duration latency)
+    {
+        _samplesUs.push_back(toMicroseconds(latency));
+        _sorted = false;
+    }
+
+    /** percentile in [0, 1]
+      */
+    double percentile(double p)
+    {
+        if (_samplesUs.empty())
+        {
+            return 0.0;
+        }
+        if (!_sorted)
+        {
+            std::sort(_samplesUs.begin(), _samplesUs.end());
+            _sorted = true;
+        }
+        size_t index = static_cast<size_t>(p * (_samplesUs.size() - 1) + 0.5);
+        return _samplesUs[std::min(index, _samplesUs.size() - 1)];
+    }
+
+private:
+    std::vector<double> _samplesUs;
+    bool _sorted = false;
+};
+
+
+/** One line of the benchmark results: list of key/values (the order is kept)
+  */
+class Record
+{
+public:
+    Record(const std::string& suite)
+    {
+        add("suite", suite);
+    }
+
+    Record& add(const std::string& key, const std::string& value)
+    {
+        _values.emplace_back(key, "\"" + value + "\"");
+        return *this;
+    }
+
+    Record& add(const std::string& key, const char* value)
+    {
+        return add(key, std::string(value));
+    }
+
+    template <typename Number>
+    Record& add(const std::string& key, Number value)
+    {
+        std::ostringstream os;
+        os << value;
+        _values.emplace_back(key, os.str());
+        return *this;
+    }
+
+    std::string toText() const
+    {
+        std::ostringstream os;
+        for (const auto& value : _values)
+        {
+            os << value.first << "=" << value.second << " ";
+        }
+        return os.str();
+    }
+
+    std::string toJson() const
+    {
+        std::ostringstream os;
+        os << "{";
+        for (size_t i = 0 ; i < _values.size() ; ++i)
+        {
+            os << (i ? ", " : "") << "\"" << _values[i].first << "\": " << _values[i].second;
+        }
+        os << "}";
+        return os.str();
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> _values;
+};
+
+
+/** Print the records as soon as they are added, and eventually save them all
+  * as JSON at the end
+  */
+class Reporter
+{
+public:
+    Reporter(const std::string& jsonPath) : _jsonPath(jsonPath)
+    {}
+
+    ~Reporter()
+    {
+        if (_jsonPath.empty())
+        {
+            return;
+        }
+        std::ofstream file(_jsonPath);
+        file << "[" << std::endl;
+        for (size_t i = 0 ; i < _records.size() ; ++i)
+        {
+            file << "  " << _records[i].toJson() << (i + 1 < _records.size() ? "," : "") << std::endl;
+        }
+        file << "]" << std::endl;
+        std::cout << "Results saved in " << _jsonPath << std::endl;
+    }
+
+    void add(const Record& record)
+    {
+        std::cout << record.toText() << std::endl;
+        _records.push_back(record);
+    }
+
+private:
+    std::string _jsonPath;
+    std::vector<Record> _records;
+};
+
+
+/** Minimal worker used to measure the scheduler overhead: the job itself
+  * costs almost nothing
+  */
+class WorkerBench : public job_scheduler::WorkerBase<int, int>
+{
+public:
+    WorkerBench(int i) : WorkerBase(i) {}
+
+    std::unique_ptr<int> operator()(const int& input) override
+    {
+        return std::unique_ptr<int>(new int(input + 1));
+    }
+};
+
+
+/** Same as WorkerBench but without WorkerBase: the call is resolved at compile
+  * time (no virtual call)
+  */
+class WorkerBenchStatic
+{
+public:
+    WorkerBenchStatic(int) {}
+
+    std::unique_ptr<int> operator()(const int& input)
+    {
+        return std::unique_ptr<int>(new int(input + 1));
+    }
+};
+
+
+/** Worker for which one job over 50 is slow (ex: complex frame), which block
+  * the output of all the following jobs
+  */
+class WorkerBenchSlowHead : public job_scheduler::WorkerBase<int, int>
+{
+public:
+    WorkerBenchSlowHead(int i) : WorkerBase(i) {}
+
+    std::unique_ptr<int> operator()(const int& input) override
+    {
+        if (input % 50 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return std::unique_ptr<int>(new int(input + 1));
+    }
+};
+
+
+/** Worker copying the input frame into an output frame. The output frame is
+  * taken from the pool if any
+  */
+class WorkerBenchFrame : public job_scheduler::WorkerBase<Frame, Frame>
+{
+public:
+    WorkerBenchFrame(int i, job_scheduler::ObjectPool<Frame>* pool) : WorkerBase(i), _pool(pool) {}
+
+    std::unique_ptr<Frame> operator()(const Frame& input) override
+    {
+        std::unique_ptr<Frame> output = _pool ? _pool->acquire() : std::unique_ptr<Frame>(new Frame());
+        output->resize(input.size());  // No allocation if the frame is recycled
+        std::memcpy(output->data(), input.data(), input.size());
+        return output;
+    }
+
+private:
+    job_scheduler::ObjectPool<Frame>* _pool;
+};
+
+
+/** Checksum of a record, read from the mapped file (RecordView) or from a
+  * copy (Frame)
+  */
+struct WorkerBenchChecksum
+{
+    WorkerBenchChecksum(int) {}
+
+    static std::unique_ptr<size_t> checksum(const char* data, size_t size)
+    {
+        size_t sum = 0;
+        for (size_t i = 0 ; i < size ; ++i)
+        {
+            sum += static_cast<unsigned char>(data[i]);
+        }
+        return std::unique_ptr<size_t>(new size_t(sum));
+    }
+};
+
+struct WorkerBenchChecksumView : WorkerBenchChecksum
+{
+    WorkerBenchChecksumView(int i) : WorkerBenchChecksum(i) {}
+
+    std::unique_ptr<size_t> operator()(const job_scheduler::RecordView& record) const
+    {
+        return checksum(record.data, record.size);
+    }
+};
+
+struct WorkerBenchChecksumCopy : WorkerBenchChecksum
+{
+    WorkerBenchChecksumCopy(int i) : WorkerBenchChecksum(i) {}
+
+    std::unique_ptr<size_t> operator()(const Frame& record) const
+    {
+        return checksum(record.data(), record.size());
+    }
+};
+
+
+/** Read fixed size records of a file by copying them into user space buffers
+  * (reference for the MappedFeeder)
+  */
+class FeederBenchFileCopy
+{
+public:
+    FeederBenchFileCopy(const std::string& path, size_t record_size) :
+        _file(new std::ifstream(path, std::ios::binary)), _record_size(record_size)
+    {}
+
+    job_scheduler::FeedStatus operator() (std::vector<std::unique_ptr<Frame>>& inputs, size_t maxInputs)
+    {
+        while (inputs.size() < maxInputs)
+        {
+            std::unique_ptr<Frame> record(new Frame(_record_size));
+            if (!_file->read(record->data(), _record_size))
+            {
+                return job_scheduler::FeedStatus::END;
+            }
+            inputs.push_back(std::move(record));
+        }
+        return job_scheduler::FeedStatus::MORE;
+    }
+
+private:
+    std::unique_ptr<std::ifstream> _file;  // The feeder has to be movable
+    size_t _record_size;
+};
+
+
+/** Generate nb_frames frames of the given size, taken from the pool if any
+  */
+class FeederBenchFrame
+{
+public:
+    FeederBenchFrame(int nb_frames, size_t frame_size, job_scheduler::ObjectPool<Frame>* pool) :
+        _counter(0), _nb_frames(nb_frames), _frame_size(frame_size), _pool(pool)
+    {}
+
+    std::unique_ptr<Frame> operator() ()
+    {
+        if (_counter >= _nb_frames)
+        {
+            throw job_scheduler::ExpiredException();
+        }
+        std::unique_ptr<Frame> frame = _pool ? _pool->acquire() : std::unique_ptr<Frame>(new Frame());
+        frame->resize(_frame_size);
+        std::memset(frame->data(), _counter++, _frame_size);
+        return frame;
+    }
+
+private:
+    int _counter;
+    int _nb_frames;
+    size_t _frame_size;
+    job_scheduler::ObjectPool<Frame>* _pool;
+};
+
+
+/** Generate the values from 0 to max_value before expiring
+  */
+class FeederBench
+{
+public:
+    FeederBench(int max_value) : _counter(0), _max_value(max_value)
+    {}
+
+    std::unique_ptr<int> operator() ()
+    {
+        if (_counter < _max_value)
+        {
+            return std::unique_ptr<int>(new int(_counter++));
+        }
+        throw job_scheduler::ExpiredException();
+    }
+
+private:
+    int _counter;
+    int _max_value;
+};
+
+
+/** FeederBench called through a std::function (type erased call)
+  */
+class FeederBenchErased
+{
+public:
+    FeederBenchErased(int max_value) : _feeder(FeederBench(max_value))
+    {}
+
+    std::unique_ptr<int> operator() ()
+    {
+        return _feeder();
+    }
+
+private:
+    std::function<std::unique_ptr<int>()> _feeder;
+};
+
+
+/** Same as FeederBench with the batch protocol (no exception at the end)
+  */
+class FeederBenchBatch
+{
+public:
+    FeederBenchBatch(int max_value) : _counter(0), _max_value(max_value)
+    {}
+
+    job_scheduler::FeedStatus operator() (std::vector<std::unique_ptr<int>>& inputs, size_t maxInputs)
+    {
+        while (inputs.size() < maxInputs && _counter < _max_value)
+        {
+            inputs.emplace_back(new int(_counter++));
+        }
+        return _counter < _max_value ? job_scheduler::FeedStatus::MORE : job_scheduler::FeedStatus::END;
+    }
+
+private:
+    int _counter;
+    int _max_value;
+};
+
+
+/** Chunk feeder for which producing an input is expensive (ex: decoding),
+  * called concurrently by the feeder threads
+  */
+class FeederBenchChunk
+{
+public:
+    FeederBenchChunk(int max_value, size_t chunk_size, std::chrono::nanoseconds cost) :
+        _max_value(max_value),
+        _chunk_size(chunk_size),
+        _cost(cost)
+    {}
+
+    job_scheduler::FeedStatus operator() (size_t chunk, std::vector<std::unique_ptr<int>>& inputs) const
+    {
+        size_t begin = chunk * _chunk_size;
+        size_t end = std::min(begin + _chunk_size, static_cast<size_t>(_max_value));
+        for (size_t i = begin ; i < end ; ++i)
+        {
+            busyWait(_cost);
+            inputs.emplace_back(new int(static_cast<int>(i)));
+        }
+        return end < static_cast<size_t>(_max_value) ? job_scheduler::FeedStatus::MORE : job_scheduler::FeedStatus::END;
+    }
+
+private:
+    int _max_value;
+    size_t _chunk_size;
+    std::chrono::nanoseconds _cost;
+};
+
+
+/** Input of the sweep benchmark: carries its creation time (to measure the
+  * end-to-end latency), its service time and its payload
+  */
+struct SweepInput
+{
+    Clock::time_point produced;
+    std::chrono::nanoseconds service;
+    Frame payload;
+    size_t key;  // Used by the KEYED ordering (ex: camera id)
+};
+
+
+struct SweepOutput
+{
+    Clock::time_point produced;
+    Frame payload;
+};
+
+
+/** Simulate a CPU bound job of the input service time which copy the payload
+  */
+class WorkerSweep : public job_scheduler::WorkerBase<SweepInput, SweepOutput>
+{
+public:
+    WorkerSweep(int i) : WorkerBase(i) {}
+
+    std::unique_ptr<SweepOutput> operator()(const SweepInput& input) override
+    {
+        busyWait(input.service);
+        std::unique_ptr<SweepOutput> output(new SweepOutput());
+        output->produced = input.produced;
+        output->payload = input.payload;
+        return output;
+    }
+};
+
+
+/** Simulate a job offloaded to a device (the thread sleeps while the device
+  * runs) on heterogeneous devices: worker 0 has the input service time, the
+  * other ones are slowdown times slower
+  */
+class WorkerDevice : public job_scheduler::WorkerBase<SweepInput, SweepOutput>
+{
+public:
+    WorkerDevice(int i, double slowdown) : WorkerBase(i), _speed(i == 0 ? 1.0 : slowdown) {}
+
+    std::unique_ptr<SweepOutput> operator()(const SweepInput& input) override
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(static_cast<long>(input.service.count() * _speed)));
+        std::unique_ptr<SweepOutput> output(new SweepOutput());
+        output->produced = input.produced;
+        return output;
+    }
+
+private:
+    double _speed;
+};
+
+
+/** Simulate a job offloaded to a device which sometimes stalls (ex: throttled
+  * or hitting a slow path): a run takes stallFactor times the input service
+  * time with the probability stallRate, whatever the input
+  */
+class WorkerStraggler : public job_scheduler::WorkerBase<SweepInput, SweepOutput>
+{
+public:
+    WorkerStraggler(int i, double stallRate, double stallFactor) :
+        WorkerBase(i), _engine(static_cast<std::mt19937::result_type>(i + 1)), _stall(stallRate), _stallFactor(stallFactor)
+    {}
+
+    std::unique_ptr<SweepOutput> operator()(const SweepInput& input) override
+    {
+        double factor = _stall(_engine) ? _stallFactor : 1.0;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(static_cast<long>(input.service.count() * factor)));
+        std::unique_ptr<SweepOutput> output(new SweepOutput());
+        output->produced = input.produced;
+        return output;
+    }
+
+private:
+    std::mt19937 _engine;
+    std::bernoulli_distribution _stall;
+    double _stallFactor;
+};
+
+
+/** Memory bound worker: each job reads its whole scratch buffer. The buffer is
+  * allocated and first touched by the constructor, so it lands on the NUMA
+  * node of the thread which constructs the worker
+  */
+class WorkerScratch : public job_scheduler::WorkerBase<int, int>
+{
+public:
+    WorkerScratch(int i, size_t scratchSize) : WorkerBase(i), _scratch(scratchSize, static_cast<char>(i)) {}
+
+    std::unique_ptr<int> operator()(const int& input) override
+    {
+        long sum = 0;
+        for (size_t i = 0 ; i < _scratch.size() ; i += 64)  // One read per cache line
+        {
+            sum += _scratch[i];
+        }
+        _scratch[static_cast<size_t>(input) % _scratch.size()] = static_cast<char>(sum);  // The reads cannot be skipped
+        return std::unique_ptr<int>(new int(input + static_cast<int>(sum & 1)));
+    }
+
+private:
+    std::vector<char> _scratch;
+};
+
+
+/** Generate nb_jobs inputs with the given service time distribution and
+  * payload size. The inputs are spread round robin over nb_keys keys
+  */
+class FeederSweep
+{
+public:
+    FeederSweep(int nb_jobs, ServiceDistribution distribution, double mean_us, size_t payload_size, size_t nb_keys = 1) :
+        _counter(0), _nb_jobs(nb_jobs), _generator(distribution, mean_us), _payload_size(payload_size), _nb_keys(nb_keys)
+    {}
+
+    std::unique_ptr<SweepInput> operator() ()
+    {
+        if (_counter >= _nb_jobs)
+        {
+            throw job_scheduler::ExpiredException();
+        }
+        ++_counter;
+        std::unique_ptr<SweepInput> input(new SweepInput());
+        input->service = _generator.next();
+        input->payload.assign(_payload_size, static_cast<char>(_counter));
+        input->key = _counter % _nb_keys;
+        input->produced = Clock::now();
+        return input;
+    }
+
+private:
+    int _counter;
+    int _nb_jobs;
+    ServiceTimeGenerator _generator;
+    size_t _payload_size;
+    size_t _nb_keys;
+};
+
+
+#endif
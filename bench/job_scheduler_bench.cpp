@@ -0,0 +1,1253 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <job_scheduler.hpp>
+#include <mappedfeeder.hpp>  // POSIX only, not part of job_scheduler.hpp
+#include <orderedsink.hpp>  // POSIX only, not part of job_scheduler.hpp
+
+#include "bench_utils.hpp"
+
+
+/** Command line options of the benchmark
+  */
+struct Options
+{
+    int nbJobs = 20000;  // Maximum number of jobs per run
+    bool full = false;  // Sweep over all the parameters (long)
+    std::string jsonPath;  // Save the results as JSON
+    std::vector<std::string> suites;  // Suites to run (all if empty)
+};
+
+
+using Suite = std::function<void(const Options&, Reporter&)>;
+
+
+std::string toString(job_scheduler::DispatchMode mode)
+{
+    switch (mode)
+    {
+        case job_scheduler::DispatchMode::ASYNC: return "async";
+        case job_scheduler::DispatchMode::POOL: return "pool";
+        case job_scheduler::DispatchMode::WORK_STEALING: return "work_stealing";
+    }
+    return "unknown";
+}
+
+
+std::string toString(job_scheduler::OrderingMode ordering)
+{
+    switch (ordering)
+    {
+        case job_scheduler::OrderingMode::GLOBAL: return "global";
+        case job_scheduler::OrderingMode::KEYED: return "keyed";
+        case job_scheduler::OrderingMode::UNORDERED: return "unordered";
+    }
+    return "unknown";
+}
+
+
+std::string toString(job_scheduler::WaitStrategy strategy)
+{
+    switch (strategy)
+    {
+        case job_scheduler::WaitStrategy::BLOCK: return "block";
+        case job_scheduler::WaitStrategy::SPIN_THEN_BLOCK: return "spin_then_block";
+        case job_scheduler::WaitStrategy::BUSY_POLL: return "busy_poll";
+    }
+    return "unknown";
+}
+
+
+std::string toStringSize(size_t size)
+{
+    return size == job_scheduler::UNLIMITED ? std::string("unlimited") : std::to_string(size);
+}
+
+
+/** Process nb_jobs through a scheduler and return the throughput in jobs/sec
+  * The feeder is given as FeederFn (ex: std::function to measure the cost of
+  * the type erasure)
+  */
+template <template <typename> class InputQueue = job_scheduler::QueueThread, class Worker = WorkerBench, class FeederFn = FeederBench>
+Record benchDispatch(const std::string& suite, job_scheduler::DispatchMode mode, int nb_workers, int nb_jobs, size_t maxInputSize = 1)
+{
+    job_scheduler::QueueScheduler<Worker, InputQueue> queue{maxInputSize, job_scheduler::UNLIMITED, mode};
+    queue.add_workers({}, nb_workers);
+
+    auto start = Clock::now();
+
+    queue.launch(FeederFn(nb_jobs));
+
+    int nb_popped = 0;
+    while(std::unique_ptr<int> out = queue.pop())
+    {
+        ++nb_popped;
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    if (nb_popped != nb_jobs)
+    {
+        std::cerr << "Error: " << nb_popped << " jobs popped instead of " << nb_jobs << std::endl;
+    }
+
+    Record record(suite);
+    record.add("mode", toString(mode))
+        .add("workers", nb_workers)
+        .add("max_input", toStringSize(maxInputSize))
+        .add("jobs", nb_jobs)
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / elapsed.count()))
+        .add("peak_out_of_order", queue.peak_out_of_order());
+    return record;
+}
+
+
+/** Compare the ASYNC, POOL and WORK_STEALING dispatch on empty jobs
+  */
+void suiteDispatch(const Options& options, Reporter& reporter)
+{
+    for (int nb_workers : {1, 2, 4, 8})
+    {
+        reporter.add(benchDispatch("dispatch", job_scheduler::DispatchMode::ASYNC, nb_workers, options.nbJobs));
+        reporter.add(benchDispatch("dispatch", job_scheduler::DispatchMode::POOL, nb_workers, options.nbJobs));
+        reporter.add(benchDispatch("dispatch", job_scheduler::DispatchMode::WORK_STEALING, nb_workers, options.nbJobs));
+        reporter.add(benchDispatch("dispatch", job_scheduler::DispatchMode::WORK_STEALING, nb_workers, options.nbJobs, 64)); // Enough inputs to steal
+    }
+}
+
+
+/** Compare a WorkerBase worker fed through a std::function with a worker and
+  * a feeder resolved at compile time, on empty jobs
+  */
+void suiteStaticDispatch(const Options& options, Reporter& reporter)
+{
+    const size_t maxInputSize = 64;
+    for (job_scheduler::DispatchMode mode : {job_scheduler::DispatchMode::POOL, job_scheduler::DispatchMode::WORK_STEALING})
+    for (int nb_workers : {1, 4})
+    {
+        reporter.add(benchDispatch<job_scheduler::QueueThread, WorkerBench, FeederBenchErased>("static_dispatch", mode, nb_workers, options.nbJobs, maxInputSize)
+            .add("worker", "virtual"));
+        reporter.add(benchDispatch<job_scheduler::QueueThread, WorkerBenchStatic, FeederBench>("static_dispatch", mode, nb_workers, options.nbJobs, maxInputSize)
+            .add("worker", "static"));
+    }
+}
+
+
+/** Compare the single input feeder (one call, one push and one exception at
+  * the end) with the batch feeder protocol, on empty jobs
+  */
+void suiteFeeder(const Options& options, Reporter& reporter)
+{
+    const size_t maxInputSize = 64;
+    for (job_scheduler::DispatchMode mode : {job_scheduler::DispatchMode::POOL, job_scheduler::DispatchMode::WORK_STEALING})
+    for (int nb_workers : {1, 4})
+    {
+        reporter.add(benchDispatch<job_scheduler::QueueThread, WorkerBenchStatic, FeederBench>("feeder", mode, nb_workers, options.nbJobs, maxInputSize)
+            .add("feeder", "single"));
+        reporter.add(benchDispatch<job_scheduler::QueueThread, WorkerBenchStatic, FeederBenchBatch>("feeder", mode, nb_workers, options.nbJobs, maxInputSize)
+            .add("feeder", "batch"));
+    }
+}
+
+
+/** Compare the input queue implementations on empty jobs
+  */
+void suiteInputQueue(const Options& options, Reporter& reporter)
+{
+    const size_t maxInputSize = 64;
+    for (int nb_workers : {1, 2, 4, 8})
+    {
+        reporter.add(benchDispatch<job_scheduler::QueueThread>("input_queue", job_scheduler::DispatchMode::POOL, nb_workers, options.nbJobs, maxInputSize)
+            .add("queue", "QueueThread"));
+        reporter.add(benchDispatch<job_scheduler::QueueRingSPSC>("input_queue", job_scheduler::DispatchMode::POOL, nb_workers, options.nbJobs, maxInputSize)
+            .add("queue", "QueueRingSPSC"));
+        reporter.add(benchDispatch<job_scheduler::QueueRingMPMC>("input_queue", job_scheduler::DispatchMode::POOL, nb_workers, options.nbJobs, maxInputSize)
+            .add("queue", "QueueRingMPMC"));
+    }
+}
+
+
+/** Run jobs with a slow head-of-line job every 50 jobs and show how the reorder
+  * window bounds the outputs waiting in memory
+  */
+void suiteReorderWindow(const Options& options, Reporter& reporter)
+{
+    const int nb_workers = 4;
+    const int nb_jobs = std::max(options.nbJobs / 10, 100);
+
+    for (size_t window : {job_scheduler::UNLIMITED, size_t(64), size_t(8)})
+    {
+        job_scheduler::QueueScheduler<WorkerBenchSlowHead> queue{16, window, job_scheduler::DispatchMode::POOL};
+        queue.add_workers({}, nb_workers);
+
+        auto start = Clock::now();
+
+        queue.launch(FeederBench(nb_jobs));
+        while(std::unique_ptr<int> out = queue.pop())
+        {
+        }
+
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        Record record("reorder_window");
+        record.add("window", toStringSize(window))
+            .add("workers", nb_workers)
+            .add("jobs", nb_jobs)
+            .add("jobs_per_sec", static_cast<long>(nb_jobs / elapsed.count()))
+            .add("peak_out_of_order", queue.peak_out_of_order())
+            .add("window_stalls", queue.window_stalls())
+            .add("window_stalls_ms", std::chrono::duration_cast<std::chrono::milliseconds>(queue.window_stalls_duration()).count());
+        reporter.add(record);
+    }
+}
+
+
+/** Process frames with or without the buffer pools and report the number of
+  * buffers allocated
+  */
+void suitePools(const Options& options, Reporter& reporter)
+{
+    const int nb_workers = 4;
+    const int nb_frames = std::max(options.nbJobs / 50, 20);
+    const size_t frame_size = 4 * 1024 * 1024;
+
+    for (bool use_pools : {false, true})
+    {
+        job_scheduler::QueueScheduler<WorkerBenchFrame, job_scheduler::QueueRingSPSC> queue{4, 16, job_scheduler::DispatchMode::POOL};
+        queue.add_workers({use_pools ? &queue.output_pool() : nullptr}, nb_workers);
+        queue.set_recycling(use_pools);
+
+        auto start = Clock::now();
+
+        queue.launch(FeederBenchFrame(nb_frames, frame_size, use_pools ? &queue.input_pool() : nullptr));
+        while(std::unique_ptr<Frame> out = queue.pop())
+        {
+            queue.recycle(std::move(out));  // Deleted if the pools are not used (nobody acquire from the pool)
+        }
+
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        Record record("pools");
+        record.add("buffers", use_pools ? "pools" : "new")
+            .add("workers", nb_workers)
+            .add("payload_bytes", frame_size)
+            .add("jobs", nb_frames)
+            .add("jobs_per_sec", static_cast<long>(nb_frames / elapsed.count()))
+            .add("input_allocations", queue.input_pool().nb_allocations())
+            .add("output_allocations", queue.output_pool().nb_allocations());
+        reporter.add(record);
+    }
+}
+
+
+/** Process a file split in fixed size records, either memory mapped and given
+  * to the workers as views (MappedFeeder) or copied into buffers
+  */
+template <class Worker, class FeederFn>
+Record benchMappedFeeder(const std::string& feeder, FeederFn feederFn, size_t file_size, size_t record_size)
+{
+    const int nb_workers = 4;
+    const size_t nb_records = file_size / record_size;
+
+    job_scheduler::QueueScheduler<Worker> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);
+
+    auto start = Clock::now();
+
+    queue.launch(std::move(feederFn));
+    size_t checksum = 0;
+    while(std::unique_ptr<size_t> out = queue.pop())
+    {
+        checksum += *out;
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    Record record("mapped_feeder");
+    record.add("feeder", feeder)
+        .add("workers", nb_workers)
+        .add("record_bytes", record_size)
+        .add("jobs", nb_records)
+        .add("jobs_per_sec", static_cast<long>(nb_records / elapsed.count()))
+        .add("mb_per_sec", static_cast<long>(file_size / elapsed.count() / (1024 * 1024)))
+        .add("checksum", checksum);
+    return record;
+}
+
+
+void suiteMappedFeeder(const Options& options, Reporter& reporter)
+{
+    const std::string path = "job_scheduler_bench.tmp";
+    const size_t file_size = (options.full ? 1024 : 128) * 1024 * 1024;
+    {
+        std::ofstream file(path, std::ios::binary);
+        Frame block(1024 * 1024);
+        for (size_t i = 0 ; i < block.size() ; ++i)
+        {
+            block[i] = static_cast<char>(i * 31);
+        }
+        for (size_t written = 0 ; written < file_size ; written += block.size())
+        {
+            file.write(block.data(), block.size());
+        }
+    }
+
+    for (size_t record_size : {4 * 1024, 256 * 1024})
+    {
+        reporter.add(benchMappedFeeder<WorkerBenchChecksumCopy>("copy", FeederBenchFileCopy(path, record_size), file_size, record_size));
+        reporter.add(benchMappedFeeder<WorkerBenchChecksumView>("mapped", job_scheduler::MappedFeeder::fixed_size(path, record_size), file_size, record_size));
+    }
+    std::remove(path.c_str());
+}
+
+
+/** How the outputs are consumed by benchSink
+  */
+enum class SinkMode
+{
+    DISCARD,  // Popped and deleted (throughput of the workers)
+    POP_WRITE,  // Popped and written one by one by the main thread
+    SINK_UNBATCHED,  // OrderedSink writing each output
+    SINK  // OrderedSink with the default policy
+};
+
+
+std::string toString(SinkMode mode)
+{
+    switch (mode)
+    {
+        case SinkMode::DISCARD: return "discard";
+        case SinkMode::POP_WRITE: return "pop_write";
+        case SinkMode::SINK_UNBATCHED: return "sink_unbatched";
+        case SinkMode::SINK: return "sink";
+    }
+    return "";
+}
+
+
+/** Throughput of the serialization of the outputs compared to the throughput
+  * of the workers
+  */
+Record benchSink(SinkMode mode, size_t payload_size, int maxJobs)
+{
+    const int nb_workers = 4;
+    const int nb_jobs = std::min(maxJobs, static_cast<int>((256 * 1024 * 1024) / payload_size));  // At most 256MB written
+    const std::string path = "job_scheduler_bench_sink.tmp";
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    using Queue = job_scheduler::QueueScheduler<WorkerBenchFrame>;
+    Queue queue{16, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({nullptr}, nb_workers);
+
+    auto start = Clock::now();
+
+    queue.launch(FeederBenchFrame(nb_jobs, payload_size, nullptr));
+    size_t nb_writes = 0;
+    if (mode == SinkMode::DISCARD || mode == SinkMode::POP_WRITE)
+    {
+        while(std::unique_ptr<Frame> out = queue.pop())
+        {
+            if (mode == SinkMode::POP_WRITE && ::write(fd, out->data(), out->size()) >= 0)
+            {
+                ++nb_writes;
+            }
+        }
+    }
+    else
+    {
+        job_scheduler::SinkPolicy policy;
+        if (mode == SinkMode::SINK_UNBATCHED)
+        {
+            policy.maxOutputs = 1;
+        }
+        job_scheduler::OrderedSink<Queue> sink{queue, fd, policy};
+        sink.wait();
+        nb_writes = sink.nb_writes();
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    ::close(fd);
+    std::remove(path.c_str());
+
+    Record record("sink");
+    record.add("output", toString(mode))
+        .add("workers", nb_workers)
+        .add("payload_bytes", payload_size)
+        .add("jobs", nb_jobs)
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / elapsed.count()))
+        .add("mb_per_sec", static_cast<long>(nb_jobs * payload_size / elapsed.count() / (1024 * 1024)))
+        .add("writes", nb_writes);
+    return record;
+}
+
+
+void suiteSink(const Options& options, Reporter& reporter)
+{
+    for (size_t payload_size : {256, 64 * 1024})
+    for (SinkMode mode : {SinkMode::DISCARD, SinkMode::POP_WRITE, SinkMode::SINK_UNBATCHED, SinkMode::SINK})
+    {
+        reporter.add(benchSink(mode, payload_size, options.nbJobs));
+    }
+}
+
+
+/** Three stages chained with launch_from, or glued by threads popping a
+  * stage and pushing its outputs in a queue read by a std::function feeder of
+  * the next stage
+  */
+Record benchPipeline(bool chained, int maxJobs)
+{
+    using Stage = job_scheduler::QueueScheduler<WorkerBenchStatic>;
+    const int nb_stages = 3;
+    const int nb_workers = 2;
+    const int nb_jobs = maxJobs;
+
+    std::vector<std::unique_ptr<Stage>> stages;
+    for (int i = 0 ; i < nb_stages ; ++i)
+    {
+        stages.emplace_back(new Stage{16, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL});
+        stages.back()->add_workers({}, nb_workers);
+        stages.back()->set_reorder_window(64);
+    }
+
+    auto start = Clock::now();
+
+    std::vector<std::unique_ptr<job_scheduler::QueueThread<std::unique_ptr<int>>>> hops;
+    std::vector<std::thread> glues;
+    stages.front()->launch(FeederBench(nb_jobs));
+    for (int i = 1 ; i < nb_stages ; ++i)
+    {
+        if (chained)
+        {
+            stages[i]->launch_from(*stages[i - 1]);
+            continue;
+        }
+        hops.emplace_back(new job_scheduler::QueueThread<std::unique_ptr<int>>(16));
+        job_scheduler::QueueThread<std::unique_ptr<int>>* hop = hops.back().get();
+        Stage* upstream = stages[i - 1].get();
+        glues.emplace_back([hop, upstream]() {
+            while(std::unique_ptr<int> out = upstream->pop())
+            {
+                hop->push_back(std::move(out));
+            }
+            hop->push_back(nullptr);
+        });
+        stages[i]->launch(std::function<std::unique_ptr<int>()>([hop]() { return hop->pop_front(); }));
+    }
+
+    int expected = nb_stages;  // FeederBench starts at 0 and each stage adds 1
+    bool ordered = true;
+    while(std::unique_ptr<int> out = stages.back()->pop())
+    {
+        ordered = ordered && *out == expected++;
+    }
+    for (std::thread& glue : glues)
+    {
+        glue.join();
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    Record record("pipeline");
+    record.add("stages", nb_stages)
+        .add("link", chained ? "launch_from" : "pop_refeed")
+        .add("workers_per_stage", nb_workers)
+        .add("jobs", nb_jobs)
+        .add("ordered", ordered ? "yes" : "no")
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / elapsed.count()));
+    return record;
+}
+
+
+void suitePipeline(const Options& options, Reporter& reporter)
+{
+    reporter.add(benchPipeline(false, options.nbJobs));
+    reporter.add(benchPipeline(true, options.nbJobs));
+}
+
+
+/** Throughput of a consumer popping the outputs one by one or all the ready
+  * ones at once, on empty jobs
+  */
+Record benchConsumer(bool batched, int nb_workers, int nb_jobs)
+{
+    job_scheduler::QueueScheduler<WorkerBenchStatic> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);
+
+    auto start = Clock::now();
+
+    queue.launch(FeederBenchBatch(nb_jobs));
+    size_t nb_calls = 0;
+    if (batched)
+    {
+        std::vector<std::unique_ptr<int>> outputs;
+        while (outputs.empty() || outputs.back())
+        {
+            outputs.clear();
+            queue.pop_batch(outputs, 256);
+            ++nb_calls;
+        }
+    }
+    else
+    {
+        while(std::unique_ptr<int> out = queue.pop())
+        {
+            ++nb_calls;
+        }
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    Record record("consumer");
+    record.add("pop", batched ? "pop_batch" : "pop")
+        .add("workers", nb_workers)
+        .add("jobs", nb_jobs)
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / elapsed.count()))
+        .add("pop_calls", nb_calls);
+    return record;
+}
+
+
+void suiteConsumer(const Options& options, Reporter& reporter)
+{
+    for (int nb_workers : {1, 4})
+    {
+        reporter.add(benchConsumer(false, nb_workers, options.nbJobs));
+        reporter.add(benchConsumer(true, nb_workers, options.nbJobs));
+    }
+}
+
+
+/** End-to-end latency of a live source (one input per period) with and
+  * without ttl. When the workers cannot keep up, the inputs wait longer and
+  * longer in the input queue, unless the expired ones are dropped
+  */
+Record benchDeadline(std::chrono::microseconds ttl, double load, int maxJobs)
+{
+    const int nb_workers = 2;
+    const double serviceUs = 100;
+    const int nb_jobs = std::min(maxJobs, 4000);
+    const Clock::duration period = std::chrono::nanoseconds(static_cast<long>(serviceUs * 1000 / nb_workers / load));
+
+    FeederSweep source(nb_jobs, ServiceDistribution::FIXED, serviceUs, 0);
+    Clock::time_point next = Clock::now();
+
+    job_scheduler::QueueScheduler<WorkerSweep> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);
+    queue.set_ttl(ttl);
+
+    LatencyRecorder latencies;
+    latencies.reserve(nb_jobs);
+
+    queue.launch([&source, &next, period]() {
+        std::this_thread::sleep_until(next);
+        next += period;
+        return source();
+    });
+    while(std::unique_ptr<SweepOutput> out = queue.pop())  // The dropped jobs are skipped
+    {
+        latencies.add(Clock::now() - out->produced);
+    }
+
+    Record record("deadline");
+    record.add("ttl_us", static_cast<long>(ttl.count()))
+        .add("load", load)
+        .add("jobs", nb_jobs)
+        .add("dropped", queue.nb_dropped())
+        .add("latency_p50_us", latencies.percentile(0.5))
+        .add("latency_p99_us", latencies.percentile(0.99));
+    return record;
+}
+
+
+void suiteDeadline(const Options& options, Reporter& reporter)
+{
+    for (double load : {0.8, 1.5})
+    {
+        reporter.add(benchDeadline(std::chrono::microseconds(0), load, options.nbJobs));
+        reporter.add(benchDeadline(std::chrono::microseconds(1000), load, options.nbJobs));
+    }
+}
+
+
+/** Bursty source: bursts of jobs arriving faster than a single worker can
+  * process them, separated by quiet periods. Compare a fixed pool sized for
+  * the average, a fixed pool sized for the peak, and the autoscaling between
+  * both (maxWorkers == 0 for a fixed pool)
+  */
+Record benchAutoscaling(int nbWorkers, size_t maxWorkers, int maxJobs)
+{
+    const double serviceUs = 200;
+    const int burst = 200;
+    const int nb_jobs = std::min(maxJobs, 5 * burst);
+    const Clock::duration period = std::chrono::microseconds(70);  // ~3 workers busy during a burst
+    const Clock::duration pause = std::chrono::milliseconds(60);
+
+    FeederSweep source(nb_jobs, ServiceDistribution::FIXED, serviceUs, 0);
+    Clock::time_point next = Clock::now();
+    int counter = 0;
+
+    job_scheduler::QueueScheduler<WorkerSweep> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nbWorkers);
+    if (maxWorkers > 0)
+    {
+        job_scheduler::ScalingPolicy policy{static_cast<size_t>(nbWorkers), maxWorkers};
+        policy.interval = std::chrono::milliseconds(1);
+        policy.nbSamples = 3;
+        queue.set_autoscaling(policy);
+    }
+
+    LatencyRecorder latencies;
+    latencies.reserve(nb_jobs);
+    double sumWorkers = 0;  // Sampled at each pop
+    int nbPopped = 0;
+
+    Clock::time_point start = Clock::now();
+    queue.launch([&source, &next, &counter, period, pause, burst]() {
+        std::this_thread::sleep_until(next);
+        next += ++counter % burst == 0 ? pause : period;
+        return source();
+    });
+    while(std::unique_ptr<SweepOutput> out = queue.pop())
+    {
+        latencies.add(Clock::now() - out->produced);
+        sumWorkers += queue.nb_workers();
+        ++nbPopped;
+    }
+    double duration = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Record record("autoscaling");
+    record.add("workers", nbWorkers)
+        .add("max_workers", maxWorkers)
+        .add("jobs", nb_jobs)
+        .add("mean_workers", nbPopped > 0 ? sumWorkers / nbPopped : 0.0)
+        .add("duration_s", duration)
+        .add("latency_p50_us", latencies.percentile(0.5))
+        .add("latency_p99_us", latencies.percentile(0.99));
+    return record;
+}
+
+
+void suiteAutoscaling(const Options& options, Reporter& reporter)
+{
+    reporter.add(benchAutoscaling(1, 0, options.nbJobs));
+    reporter.add(benchAutoscaling(4, 0, options.nbJobs));
+    reporter.add(benchAutoscaling(1, 4, options.nbJobs));
+}
+
+
+/** One fast and several slow devices (slowdown times slower), fed at a rate
+  * the fast one alone could sustain (with variable service times). Compare the default routing (first
+  * released worker), the cost aware routing, and the hold back of the jobs
+  * for the fast device
+  */
+Record benchRouting(const job_scheduler::RoutingPolicy& policy, double slowdown, int maxJobs)
+{
+    const int nb_workers = 4;
+    const double serviceUs = 500;
+    const int nb_jobs = std::min(maxJobs, 600);
+    const Clock::duration period = std::chrono::microseconds(static_cast<long>(serviceUs * 1.5));
+
+    FeederSweep source(nb_jobs, ServiceDistribution::EXPONENTIAL, serviceUs, 0);
+    Clock::time_point next = Clock::now();
+
+    job_scheduler::QueueScheduler<WorkerDevice> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({slowdown}, nb_workers);
+    queue.set_routing(policy);
+
+    LatencyRecorder latencies;
+    latencies.reserve(nb_jobs);
+
+    queue.launch([&source, &next, period]() {
+        std::this_thread::sleep_until(next);
+        next += period;
+        return source();
+    });
+    while(std::unique_ptr<SweepOutput> out = queue.pop())
+    {
+        latencies.add(Clock::now() - out->produced);
+    }
+
+    Record record("routing");
+    record.add("cost_aware", policy.costAware ? 1 : 0)
+        .add("hold_back", policy.holdBack)
+        .add("slowdown", slowdown)
+        .add("jobs", nb_jobs)
+        .add("held_back", queue.nb_held_back())
+        .add("latency_p50_us", latencies.percentile(0.5))
+        .add("latency_p99_us", latencies.percentile(0.99));
+    return record;
+}
+
+
+void suiteRouting(const Options& options, Reporter& reporter)
+{
+    for (double slowdown : {4.0, 10.0})
+    {
+        reporter.add(benchRouting(job_scheduler::RoutingPolicy{false}, slowdown, options.nbJobs));
+        reporter.add(benchRouting(job_scheduler::RoutingPolicy{true}, slowdown, options.nbJobs));
+        reporter.add(benchRouting(job_scheduler::RoutingPolicy{true, 2.0}, slowdown, options.nbJobs));
+    }
+}
+
+
+/** Workers which sometimes stall (stallRate of the runs are 30 times slower),
+  * with and without the re-execution of the stragglers (percentile == 0 to
+  * disable it)
+  */
+Record benchHedging(double percentile, double stallRate, int maxJobs)
+{
+    const int nb_workers = 4;
+    const double serviceUs = 300;
+    const int nb_jobs = std::min(maxJobs, 2000);
+    const Clock::duration period = std::chrono::microseconds(static_cast<long>(serviceUs / nb_workers * 2));  // 50% load
+
+    FeederSweep source(nb_jobs, ServiceDistribution::FIXED, serviceUs, 0);
+    Clock::time_point next = Clock::now();
+
+    job_scheduler::QueueScheduler<WorkerStraggler> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({stallRate, 30.0}, nb_workers);
+    if (percentile > 0)
+    {
+        queue.set_hedging(job_scheduler::HedgingPolicy{percentile});
+    }
+
+    LatencyRecorder latencies;
+    latencies.reserve(nb_jobs);
+
+    queue.launch([&source, &next, period]() {
+        std::this_thread::sleep_until(next);
+        next += period;
+        return source();
+    });
+    while(std::unique_ptr<SweepOutput> out = queue.pop())
+    {
+        latencies.add(Clock::now() - out->produced);
+    }
+
+    Record record("hedging");
+    record.add("percentile", percentile)
+        .add("stall_rate", stallRate)
+        .add("jobs", nb_jobs)
+        .add("hedged", queue.nb_hedged())
+        .add("hedges_won", queue.nb_hedges_won())
+        .add("latency_p50_us", latencies.percentile(0.5))
+        .add("latency_p99_us", latencies.percentile(0.99))
+        .add("latency_p999_us", latencies.percentile(0.999));
+    return record;
+}
+
+
+void suiteHedging(const Options& options, Reporter& reporter)
+{
+    for (double stallRate : {0.01, 0.02})
+    {
+        reporter.add(benchHedging(0, stallRate, options.nbJobs));
+        reporter.add(benchHedging(0.9, stallRate, options.nbJobs));
+        reporter.add(benchHedging(0.95, stallRate, options.nbJobs));
+    }
+}
+
+
+/** Memory bound workers (each one reading its own scratch buffer) unpinned,
+  * pinned to a core each, and spread over the NUMA nodes. Unpinned, a worker
+  * moved to another socket reads its buffer from remote memory. With a single
+  * NUMA node, per_node is a no-op (same as unpinned)
+  */
+Record benchPlacement(const std::string& placement, int maxJobs)
+{
+    const size_t scratchSize = 4 * 1024 * 1024;  // Larger than the L2 caches
+    const int nb_workers = static_cast<int>(job_scheduler::allowed_cpus().size());
+    const int nb_jobs = std::min(maxJobs, 2000);
+
+    job_scheduler::PlacementPolicy policy;
+    if (placement == "per_core")
+    {
+        policy = job_scheduler::PlacementPolicy::per_core();
+    }
+    else if (placement == "per_node")
+    {
+        policy = job_scheduler::PlacementPolicy::per_node();
+    }
+
+    job_scheduler::QueueScheduler<WorkerScratch> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.set_placement(policy);
+    queue.add_workers({scratchSize}, nb_workers);
+
+    auto start = Clock::now();
+
+    queue.launch(FeederBench(nb_jobs));
+
+    int nb_popped = 0;
+    while(std::unique_ptr<int> out = queue.pop())
+    {
+        ++nb_popped;
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    if (nb_popped != nb_jobs)
+    {
+        std::cerr << "Error: " << nb_popped << " jobs popped instead of " << nb_jobs << std::endl;
+    }
+
+    Record record("placement");
+    record.add("placement", placement)
+        .add("numa_nodes", job_scheduler::numa_nodes().size())
+        .add("workers", nb_workers)
+        .add("jobs", nb_jobs)
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / elapsed.count()));
+    return record;
+}
+
+
+void suitePlacement(const Options& options, Reporter& reporter)
+{
+    for (const char* placement : {"none", "per_core", "per_node"})
+    {
+        reporter.add(benchPlacement(placement, options.nbJobs));
+    }
+}
+
+
+/** End-to-end latency of short jobs at low load (each handoff waits for the
+  * previous thread) and CPU time used, with the same wait policy on all the
+  * handoffs. The spinning threads trade CPU for latency (on a machine with
+  * less cores than threads, they delay the threads they are waiting for)
+  */
+Record benchWaitStrategy(const job_scheduler::WaitPolicy& policy, int maxJobs)
+{
+    const int nb_workers = 2;
+    const double serviceUs = 5;
+    const int nb_jobs = std::min(maxJobs, 1000);
+    const Clock::duration period = std::chrono::microseconds(200);
+
+    FeederSweep source(nb_jobs, ServiceDistribution::FIXED, serviceUs, 0);
+    Clock::time_point next = Clock::now();
+
+    job_scheduler::QueueScheduler<WorkerSweep> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    for (job_scheduler::Handoff handoff : {job_scheduler::Handoff::INPUTS, job_scheduler::Handoff::WORKERS, job_scheduler::Handoff::JOBS, job_scheduler::Handoff::OUTPUTS})
+    {
+        queue.set_wait_policy(handoff, policy);
+    }
+    queue.add_workers({}, nb_workers);
+
+    LatencyRecorder latencies;
+    latencies.reserve(nb_jobs);
+
+    auto start = Clock::now();
+    std::clock_t cpuStart = std::clock();
+
+    queue.launch([&source, &next, period]() {
+        std::this_thread::sleep_until(next);
+        next += period;
+        return source();
+    });
+    while(std::unique_ptr<SweepOutput> out = queue.pop())
+    {
+        latencies.add(Clock::now() - out->produced);
+    }
+
+    double cpuSec = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    Record record("wait_strategy");
+    record.add("strategy", toString(policy.strategy))
+        .add("spin", policy.nbSpin)
+        .add("yield", policy.nbYield)
+        .add("jobs", nb_jobs)
+        .add("latency_p50_us", latencies.percentile(0.5))
+        .add("latency_p99_us", latencies.percentile(0.99))
+        .add("cpu_per_job_us", static_cast<long>(cpuSec * 1e6 / nb_jobs))
+        .add("cores_used", cpuSec / elapsed.count());
+    return record;
+}
+
+
+void suiteWaitStrategy(const Options& options, Reporter& reporter)
+{
+    reporter.add(benchWaitStrategy(job_scheduler::WaitPolicy{job_scheduler::WaitStrategy::BLOCK}, options.nbJobs));
+    reporter.add(benchWaitStrategy(job_scheduler::WaitPolicy{job_scheduler::WaitStrategy::SPIN_THEN_BLOCK}, options.nbJobs));
+    reporter.add(benchWaitStrategy(job_scheduler::WaitPolicy{job_scheduler::WaitStrategy::SPIN_THEN_BLOCK, 10000, 200}, options.nbJobs));
+    reporter.add(benchWaitStrategy(job_scheduler::WaitPolicy{job_scheduler::WaitStrategy::BUSY_POLL}, options.nbJobs));
+}
+
+
+/** Parameters of a sweep run
+  */
+struct SweepConfig
+{
+    job_scheduler::DispatchMode mode;
+    int nbWorkers;
+    size_t maxInputSize;
+    size_t maxOutputSize;
+    ServiceDistribution distribution;
+    double serviceUs;
+    size_t payloadSize;
+};
+
+
+/** Measure the throughput, the end-to-end latency (from the creation of the
+  * input to the pop of the output) and the scheduler overhead of a config
+  */
+Record benchSweep(const SweepConfig& config, int maxJobs)
+{
+    // Limit the duration of each run (~0.3s of jobs)
+    const size_t nbParallel = std::max<size_t>(1, std::min<size_t>(config.nbWorkers, std::thread::hardware_concurrency()));
+    int nb_jobs = maxJobs;
+    if (config.serviceUs > 0)
+    {
+        nb_jobs = std::min(nb_jobs, std::max(100, static_cast<int>(0.3e6 * nbParallel / config.serviceUs)));
+    }
+
+    job_scheduler::QueueScheduler<WorkerSweep> queue{config.maxInputSize, config.maxOutputSize, config.mode};
+    queue.add_workers({}, config.nbWorkers);
+
+    LatencyRecorder latencies;
+    latencies.reserve(nb_jobs);
+
+    // Same service times as the ones generated by the feeder
+    ServiceTimeGenerator generator(config.distribution, config.serviceUs);
+    std::chrono::nanoseconds totalService(0);
+    for (int i = 0 ; i < nb_jobs ; ++i)
+    {
+        totalService += generator.next();
+    }
+
+    auto start = Clock::now();
+
+    queue.launch(FeederSweep(nb_jobs, config.distribution, config.serviceUs, config.payloadSize));
+    while(std::unique_ptr<SweepOutput> out = queue.pop())
+    {
+        latencies.add(Clock::now() - out->produced);
+    }
+
+    Clock::duration elapsed = Clock::now() - start;
+
+    // Overhead: time spent above a perfect parallelisation of the jobs
+    double idealUs = toMicroseconds(totalService) / nbParallel;
+    double overheadUs = std::max(0.0, toMicroseconds(elapsed) - idealUs) / nb_jobs;
+
+    Record record("sweep");
+    record.add("mode", toString(config.mode))
+        .add("workers", config.nbWorkers)
+        .add("max_input", toStringSize(config.maxInputSize))
+        .add("max_output", toStringSize(config.maxOutputSize))
+        .add("service_distribution", toString(config.distribution))
+        .add("service_us", config.serviceUs)
+        .add("payload_bytes", config.payloadSize)
+        .add("jobs", nb_jobs)
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / (toMicroseconds(elapsed) * 1e-6)))
+        .add("latency_p50_us", latencies.percentile(0.5))
+        .add("latency_p99_us", latencies.percentile(0.99))
+        .add("latency_p999_us", latencies.percentile(0.999))
+        .add("overhead_us_per_job", overheadUs);
+    return record;
+}
+
+
+/** Sweep over the number of workers, the queue sizes, the service time
+  * distribution and the payload size
+  */
+void suiteSweep(const Options& options, Reporter& reporter)
+{
+    std::vector<job_scheduler::DispatchMode> modes{job_scheduler::DispatchMode::POOL};
+    std::vector<int> workers{1, 4};
+    std::vector<std::pair<size_t, size_t>> queueSizes{{1, job_scheduler::UNLIMITED}};
+    std::vector<double> servicesUs{0.0, 10.0, 1000.0};
+    std::vector<ServiceDistribution> distributions{ServiceDistribution::FIXED, ServiceDistribution::HEAVY_TAILED};
+    std::vector<size_t> payloads{0, 64 * 1024};
+    if (options.full)
+    {
+        modes.push_back(job_scheduler::DispatchMode::ASYNC);
+        modes.push_back(job_scheduler::DispatchMode::WORK_STEALING);
+        workers = {1, 2, 4, 8, 16};
+        queueSizes = {{1, job_scheduler::UNLIMITED}, {16, job_scheduler::UNLIMITED}, {16, 64}};
+        servicesUs = {0.0, 1.0, 10.0, 100.0, 1000.0};
+        distributions = {ServiceDistribution::FIXED, ServiceDistribution::EXPONENTIAL, ServiceDistribution::HEAVY_TAILED};
+        payloads = {0, 4 * 1024, 64 * 1024, 1024 * 1024};
+    }
+
+    for (job_scheduler::DispatchMode mode : modes)
+    for (int nbWorkers : workers)
+    for (const auto& queueSize : queueSizes)
+    for (double serviceUs : servicesUs)
+    for (ServiceDistribution distribution : distributions)
+    for (size_t payload : payloads)
+    {
+        if (serviceUs == 0.0 && distribution != ServiceDistribution::FIXED)
+        {
+            continue;  // All distributions are identical
+        }
+        SweepConfig config{mode, nbWorkers, queueSize.first, queueSize.second, distribution, serviceUs, payload};
+        reporter.add(benchSweep(config, options.nbJobs));
+    }
+}
+
+
+/** End-to-end latency of heavy tailed jobs spread over several keys, when the
+  * outputs are popped in the global order, per key or in completion order
+  */
+Record benchOrdering(job_scheduler::OrderingMode ordering, int nb_workers, size_t nb_keys, int maxJobs)
+{
+    const double serviceUs = 100.0;
+    const size_t nbParallel = std::max<size_t>(1, std::min<size_t>(nb_workers, std::thread::hardware_concurrency()));
+    int nb_jobs = std::min(maxJobs, static_cast<int>(0.3e6 * nbParallel / serviceUs));
+
+    job_scheduler::QueueScheduler<WorkerSweep> queue{16, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);
+    queue.set_ordering(ordering, [](const SweepInput& input) { return input.key; });
+
+    LatencyRecorder latencies;
+    latencies.reserve(nb_jobs);
+
+    auto start = Clock::now();
+
+    queue.launch(FeederSweep(nb_jobs, ServiceDistribution::HEAVY_TAILED, serviceUs, 0, nb_keys));
+    while(std::unique_ptr<SweepOutput> out = queue.pop())
+    {
+        latencies.add(Clock::now() - out->produced);
+    }
+
+    Clock::duration elapsed = Clock::now() - start;
+
+    Record record("ordering");
+    record.add("ordering", toString(ordering))
+        .add("workers", nb_workers)
+        .add("keys", nb_keys)
+        .add("jobs", nb_jobs)
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / (toMicroseconds(elapsed) * 1e-6)))
+        .add("latency_p50_us", latencies.percentile(0.5))
+        .add("latency_p99_us", latencies.percentile(0.99))
+        .add("latency_p999_us", latencies.percentile(0.999))
+        .add("peak_out_of_order", queue.peak_out_of_order());
+    return record;
+}
+
+
+/** Compare the GLOBAL, KEYED and UNORDERED ordering (head-of-line blocking)
+  */
+void suiteOrdering(const Options& options, Reporter& reporter)
+{
+    for (int nb_workers : {2, 4})
+    {
+        reporter.add(benchOrdering(job_scheduler::OrderingMode::GLOBAL, nb_workers, 8, options.nbJobs));
+        reporter.add(benchOrdering(job_scheduler::OrderingMode::KEYED, nb_workers, 8, options.nbJobs));
+        reporter.add(benchOrdering(job_scheduler::OrderingMode::UNORDERED, nb_workers, 8, options.nbJobs));
+    }
+}
+
+
+/** Throughput when the inputs are expensive to produce (10us each), for
+  * several numbers of feeder threads (chunk feeder) with the same workers
+  */
+Record benchParallelFeeder(size_t nb_feeder_threads, int nb_workers, int maxJobs)
+{
+    const std::chrono::microseconds cost(10);
+    int nb_jobs = std::min(maxJobs, 20000);
+
+    job_scheduler::QueueScheduler<WorkerBenchStatic> queue{64, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);
+    queue.set_feeder_threads(nb_feeder_threads);
+
+    auto start = Clock::now();
+
+    queue.launch(FeederBenchChunk(nb_jobs, 64, cost));
+    int expected = 1;
+    bool ordered = true;
+    while(std::unique_ptr<int> out = queue.pop())
+    {
+        ordered = ordered && *out == expected++;
+    }
+
+    Clock::duration elapsed = Clock::now() - start;
+
+    Record record("parallel_feeder");
+    record.add("feeder_threads", nb_feeder_threads)
+        .add("workers", nb_workers)
+        .add("jobs", nb_jobs)
+        .add("ordered", ordered ? "yes" : "no")
+        .add("jobs_per_sec", static_cast<long>(nb_jobs / (toMicroseconds(elapsed) * 1e-6)));
+    return record;
+}
+
+
+void suiteParallelFeeder(const Options& options, Reporter& reporter)
+{
+    for (size_t nb_feeder_threads : {1, 2, 4})
+    {
+        reporter.add(benchParallelFeeder(nb_feeder_threads, 2, options.nbJobs));
+    }
+}
+
+
+/** Push/pop throughput of a queue with several producers and consumers
+  */
+template <typename Queue>
+Record benchQueue(const std::string& name, int nb_producers, int nb_consumers, size_t maxSize, int nb_items)
+{
+    Queue queue(maxSize);
+    const int items_per_producer = nb_items / nb_producers;
+
+    auto start = Clock::now();
+
+    std::vector<std::thread> threads;
+    for (int i = 0 ; i < nb_producers ; ++i)
+    {
+        threads.emplace_back([&queue, items_per_producer]() {
+            for (int j = 0 ; j < items_per_producer ; ++j)
+            {
+                queue.push_back(j);
+            }
+        });
+    }
+    for (int i = 0 ; i < nb_consumers ; ++i)
+    {
+        threads.emplace_back([&queue]() {
+            while (queue.pop_front() >= 0)  // Negative value is the end token
+            {
+            }
+        });
+    }
+
+    for (int i = 0 ; i < nb_producers ; ++i)
+    {
+        threads[i].join();
+    }
+    for (int i = 0 ; i < nb_consumers ; ++i)
+    {
+        queue.push_back(-1);
+    }
+    for (size_t i = nb_producers ; i < threads.size() ; ++i)
+    {
+        threads[i].join();
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    Record record("queue_micro");
+    record.add("queue", name)
+        .add("producers", nb_producers)
+        .add("consumers", nb_consumers)
+        .add("max_size", toStringSize(maxSize))
+        .add("items", items_per_producer * nb_producers)
+        .add("items_per_sec", static_cast<long>(items_per_producer * nb_producers / elapsed.count()));
+    return record;
+}
+
+
+/** Microbenchmark of the queues push/pop under contention
+  */
+void suiteQueueMicro(const Options& options, Reporter& reporter)
+{
+    const int nb_items = options.nbJobs * 10;
+    for (size_t maxSize : {size_t(16), size_t(1024)})
+    {
+        reporter.add(benchQueue<job_scheduler::QueueThread<int>>("QueueThread", 1, 1, maxSize, nb_items));
+        reporter.add(benchQueue<job_scheduler::QueueRingSPSC<int>>("QueueRingSPSC", 1, 1, maxSize, nb_items));
+        reporter.add(benchQueue<job_scheduler::QueueRingMPMC<int>>("QueueRingMPMC", 1, 1, maxSize, nb_items));
+        for (int nb_threads : {2, 4})
+        {
+            reporter.add(benchQueue<job_scheduler::QueueThread<int>>("QueueThread", nb_threads, nb_threads, maxSize, nb_items));
+            reporter.add(benchQueue<job_scheduler::QueueRingMPMC<int>>("QueueRingMPMC", nb_threads, nb_threads, maxSize, nb_items));
+        }
+    }
+}
+
+
+void printUsage(const std::vector<std::pair<std::string, Suite>>& suites)
+{
+    std::cout << "Usage: job_scheduler_bench [--jobs N] [--full] [--json FILE] [SUITE...]" << std::endl;
+    std::cout << "  --jobs N     Maximum number of jobs per run (default 20000)" << std::endl;
+    std::cout << "  --full       Sweep over all the parameters (long)" << std::endl;
+    std::cout << "  --json FILE  Save the results as JSON" << std::endl;
+    std::cout << "Suites (all by default):";
+    for (const auto& suite : suites)
+    {
+        std::cout << " " << suite.first;
+    }
+    std::cout << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    const std::vector<std::pair<std::string, Suite>> suites{
+        {"dispatch", suiteDispatch},
+        {"static_dispatch", suiteStaticDispatch},
+        {"feeder", suiteFeeder},
+        {"parallel_feeder", suiteParallelFeeder},
+        {"input_queue", suiteInputQueue},
+        {"reorder_window", suiteReorderWindow},
+        {"pools", suitePools},
+        {"mapped_feeder", suiteMappedFeeder},
+        {"sink", suiteSink},
+        {"pipeline", suitePipeline},
+        {"consumer", suiteConsumer},
+        {"deadline", suiteDeadline},
+        {"autoscaling", suiteAutoscaling},
+        {"routing", suiteRouting},
+        {"hedging", suiteHedging},
+        {"placement", suitePlacement},
+        {"wait_strategy", suiteWaitStrategy},
+        {"sweep", suiteSweep},
+        {"ordering", suiteOrdering},
+        {"queue_micro", suiteQueueMicro},
+    };
+
+    Options options;
+    for (int i = 1 ; i < argc ; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc)
+        {
+            options.nbJobs = std::stoi(argv[++i]);
+        }
+        else if (arg == "--full")
+        {
+            options.full = true;
+        }
+        else if (arg == "--json" && i + 1 < argc)
+        {
+            options.jsonPath = argv[++i];
+        }
+        else if (arg == "--help" || arg == "-h")
+        {
+            printUsage(suites);
+            return 0;
+        }
+        else if (arg[0] == '-')
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(suites);
+            return 1;
+        }
+        else
+        {
+            options.suites.push_back(arg);
+        }
+    }
+
+    Reporter reporter(options.jsonPath);
+    for (const auto& suite : suites)
+    {
+        if (options.suites.empty() || std::find(options.suites.begin(), options.suites.end(), suite.first) != options.suites.end())
+        {
+            std::cout << "#### " << suite.first << " ####" << std::endl;
+            suite.second(options, reporter);
+        }
+    }
+
+    return 0;
+}
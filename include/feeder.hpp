@@ -0,0 +1,175 @@
+#ifndef JS_FEEDER_H
+#define JS_FEEDER_H
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "workertraits.hpp"
+
+
+namespace job_scheduler
+{
+
+
+/** Result of a batch (or chunk) feeder call
+  */
+enum class FeedStatus
+{
+    MORE,  // The feeder can be called again
+    END,  // End of the stream (the inputs filled by this call are still processed)
+    ERROR  // Same as END but pop() throws a FeederError once the previous outputs have been popped
+};
+
+
+// Default maximum number of inputs given to a batch feeder per call (when the
+// input queue is unlimited)
+constexpr size_t DEFAULT_FEED_BATCH = 64;
+
+
+/** Rethrown by pop() when the feeder has returned FeedStatus::ERROR
+  */
+class FeederError : public std::runtime_error
+{
+public:
+    FeederError() : std::runtime_error("The feeder returned FeedStatus::ERROR") {}
+};
+
+
+/** Calling convention of a feeder (deduced from its signature)
+  */
+enum class FeederProtocol
+{
+    ITEM,  // std::unique_ptr<Input>(): one input per call, nullptr or ExpiredException at the end
+    BATCH,  // FeedStatus(std::vector<std::unique_ptr<Input>>& inputs, size_t maxInputs): appends at most maxInputs inputs per call
+    CHUNK  // FeedStatus(size_t chunk, std::vector<std::unique_ptr<Input>>& inputs): appends the inputs of the given chunk of the source (called concurrently)
+};
+
+
+/** Feeder of a chained stage: pops the outputs of the upstream stage (a
+  * QueueScheduler or one of its StreamHandle) in their order and moves them
+  * to the next stage without copy (see QueueScheduler::launch_from).
+  * The first error of the upstream stage ends the stream (it is rethrown by
+  * the pop of the next stage). The upstream stage is still emptied so it can
+  * finish: the errors it throws meanwhile are counted in nbDiscardedErrors
+  * (if given).
+  */
+template <class Source>
+class UpstreamFeeder
+{
+public:
+    using OutputPtr = decltype(std::declval<Source&>().pop());
+
+    explicit UpstreamFeeder(Source& source, std::atomic<size_t>* nbDiscardedErrors = nullptr) :
+        _source(&source), _nbDiscardedErrors(nbDiscardedErrors)
+    {}
+
+    OutputPtr operator()()
+    {
+        try
+        {
+            return _source->pop();  // nullptr once the upstream stage is released
+        }
+        catch (...)
+        {
+            drain();
+            throw;
+        }
+    }
+
+private:
+    void drain()
+    {
+        while (true)
+        {
+            try
+            {
+                if (!_source->pop())
+                {
+                    return;
+                }
+            }
+            catch (...)
+            {
+                if (_nbDiscardedErrors)
+                {
+                    ++*_nbDiscardedErrors;  // Only the first error is forwarded
+                }
+            }
+        }
+    }
+
+    Source* _source;
+    std::atomic<size_t>* _nbDiscardedErrors;
+};
+
+
+namespace detail
+{
+
+
+/** True if FeederFn follows the batch protocol:
+  * FeedStatus(std::vector<std::unique_ptr<Input>>& inputs, size_t maxInputs)
+  */
+template <class FeederFn, typename Input, typename = void>
+struct IsBatchFeeder : std::false_type
+{
+};
+
+template <class FeederFn, typename Input>
+struct IsBatchFeeder<FeederFn, Input, typename VoidType<decltype(std::declval<FeederFn&>()(std::declval<std::vector<std::unique_ptr<Input>>&>(), size_t()))>::type> :
+    std::is_same<decltype(std::declval<FeederFn&>()(std::declval<std::vector<std::unique_ptr<Input>>&>(), size_t())), FeedStatus>
+{
+};
+
+
+/** True if FeederFn follows the single input protocol:
+  * std::unique_ptr<Input>() (nullptr or ExpiredException at the end)
+  */
+template <class FeederFn, typename Input, typename = void>
+struct IsItemFeeder : std::false_type
+{
+};
+
+template <class FeederFn, typename Input>
+struct IsItemFeeder<FeederFn, Input, typename VoidType<decltype(std::declval<FeederFn&>()())>::type> :
+    std::is_convertible<decltype(std::declval<FeederFn&>()()), std::unique_ptr<Input>>
+{
+};
+
+
+/** True if FeederFn follows the chunk protocol:
+  * FeedStatus(size_t chunk, std::vector<std::unique_ptr<Input>>& inputs)
+  */
+template <class FeederFn, typename Input, typename = void>
+struct IsChunkFeeder : std::false_type
+{
+};
+
+template <class FeederFn, typename Input>
+struct IsChunkFeeder<FeederFn, Input, typename VoidType<decltype(std::declval<FeederFn&>()(size_t(), std::declval<std::vector<std::unique_ptr<Input>>&>()))>::type> :
+    std::is_same<decltype(std::declval<FeederFn&>()(size_t(), std::declval<std::vector<std::unique_ptr<Input>>&>())), FeedStatus>
+{
+};
+
+
+template <class FeederFn, typename Input>
+struct FeederProtocolOf : std::integral_constant<
+    FeederProtocol,
+    IsChunkFeeder<FeederFn, Input>::value ? FeederProtocol::CHUNK :
+    IsBatchFeeder<FeederFn, Input>::value ? FeederProtocol::BATCH :
+    FeederProtocol::ITEM
+>
+{
+};
+
+
+} // End namespace detail
+
+
+} // End namespace
+
+#endif
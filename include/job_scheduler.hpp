@@ -3,8 +3,17 @@
 
 
 #include "workerbase.hpp"
+#include "workertraits.hpp"
+#include "feeder.hpp"
 #include "workerfactory.hpp"
+#include "waitstrategy.hpp"
 #include "queuethread.hpp"
+#include "queuering.hpp"
+#include "reorderbuffer.hpp"
+#include "objectpool.hpp"
+#include "schedulerstats.hpp"
+#include "jobtracer.hpp"
+#include "placement.hpp"
 #include "queuescheduler.hpp"
 
 
@@ -0,0 +1,222 @@
+#ifndef JS_JOBTRACER_H
+#define JS_JOBTRACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+namespace job_scheduler
+{
+
+
+/** Single event of the timeline (times relative to the tracer creation)
+  */
+struct TraceEvent
+{
+    const char* name;  // Has to be a string literal (only the pointer is kept)
+    char phase;  // Chrome trace phase: 'X' span, 'i' instant, 's'/'t'/'f' flow linking the events of a job
+    uint64_t startNs;
+    uint64_t durationNs;
+    size_t stream;  // Id of the stream of the job
+    size_t sequence;  // Position of the job in the output order of its stream
+    const char* argName;  // Optional extra argument (nullptr if none)
+    size_t arg;
+};
+
+
+/** Events recorded by a single thread (or by a single worker). Only one
+  * thread can record on a lane at a time, so no lock is needed.
+  */
+class TraceLane
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TraceLane(const std::string& name, size_t tid, Clock::time_point origin, size_t nbReservedEvents);
+
+    void span(const char* name, Clock::time_point start, Clock::time_point end, size_t stream, size_t sequence, const char* argName = nullptr, size_t arg = 0);
+    void instant(const char* name, Clock::time_point time, size_t stream, size_t sequence);
+
+    /** Link the events of a same job across lanes (phase 's' for the first
+      * one, 't' for the intermediates and 'f' for the last one). The time
+      * has to be inside a span of this lane.
+      */
+    void flow(char phase, Clock::time_point time, size_t stream, size_t sequence);
+
+    const std::string& name() const;
+    size_t tid() const;
+    const std::vector<TraceEvent>& events() const;
+
+private:
+    uint64_t to_ns(Clock::time_point time) const;
+
+    std::string _name;
+    size_t _tid;
+    Clock::time_point _origin;
+    std::vector<TraceEvent> _events;
+};
+
+
+/** Record the timeline of the jobs and export it in the Chrome trace-event
+  * format (can be opened with chrome://tracing or https://ui.perfetto.dev).
+  * Each thread records in its own lane, the only lock is taken when a lane
+  * is added. The events should be reserved (nbReservedEvents per lane) to
+  * avoid allocations while recording.
+  */
+class JobTracer
+{
+public:
+    JobTracer(size_t nbReservedEvents = 0);
+    JobTracer(const JobTracer&) = delete;
+    JobTracer& operator=(const JobTracer&) = delete;
+    ~JobTracer() = default;
+
+    /** The returned reference stay valid during the tracer lifetime
+      */
+    TraceLane& add_lane(const std::string& name);
+
+    /** WARNING: The lanes shouldn't be recorded anymore during the call
+      */
+    void write_json(std::ostream& os) const;
+
+private:
+    static void write_time(std::ostream& os, uint64_t ns);  // In microseconds
+
+    TraceLane::Clock::time_point _origin;
+    size_t _nbReservedEvents;
+
+    mutable std::mutex _mutexLanes;  // Protect the deque structure (not the events)
+    std::deque<TraceLane> _lanes;
+};
+
+
+inline TraceLane::TraceLane(const std::string& name, size_t tid, Clock::time_point origin, size_t nbReservedEvents) :
+    _name(name),
+    _tid(tid),
+    _origin(origin),
+    _events()
+{
+    _events.reserve(nbReservedEvents);
+}
+
+
+inline void TraceLane::span(const char* name, Clock::time_point start, Clock::time_point end, size_t stream, size_t sequence, const char* argName, size_t arg)
+{
+    uint64_t startNs = to_ns(start);
+    uint64_t endNs = to_ns(end);
+    _events.push_back(TraceEvent{name, 'X', startNs, endNs > startNs ? endNs - startNs : 0, stream, sequence, argName, arg});
+}
+
+
+inline void TraceLane::instant(const char* name, Clock::time_point time, size_t stream, size_t sequence)
+{
+    _events.push_back(TraceEvent{name, 'i', to_ns(time), 0, stream, sequence, nullptr, 0});
+}
+
+
+inline void TraceLane::flow(char phase, Clock::time_point time, size_t stream, size_t sequence)
+{
+    _events.push_back(TraceEvent{"job", phase, to_ns(time), 0, stream, sequence, nullptr, 0});
+}
+
+
+inline const std::string& TraceLane::name() const
+{
+    return _name;
+}
+
+
+inline size_t TraceLane::tid() const
+{
+    return _tid;
+}
+
+
+inline const std::vector<TraceEvent>& TraceLane::events() const
+{
+    return _events;
+}
+
+
+inline uint64_t TraceLane::to_ns(Clock::time_point time) const
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(time - _origin).count();
+    return elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0;
+}
+
+
+inline JobTracer::JobTracer(size_t nbReservedEvents) :
+    _origin(TraceLane::Clock::now()),
+    _nbReservedEvents(nbReservedEvents),
+    _mutexLanes(),
+    _lanes()
+{
+}
+
+
+inline TraceLane& JobTracer::add_lane(const std::string& name)
+{
+    std::lock_guard<std::mutex> guard(_mutexLanes);
+    _lanes.emplace_back(name, _lanes.size(), _origin, _nbReservedEvents);  // The deque keeps the references valid
+    return _lanes.back();
+}
+
+
+inline void JobTracer::write_json(std::ostream& os) const
+{
+    std::lock_guard<std::mutex> guard(_mutexLanes);
+
+    os << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << std::endl;
+    bool first = true;
+    for (const TraceLane& lane : _lanes)
+    {
+        os << (first ? "" : ",\n")
+           << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << lane.tid()
+           << ", \"args\": {\"name\": \"" << lane.name() << "\"}}";
+        first = false;
+
+        for (const TraceEvent& event : lane.events())
+        {
+            os << ",\n{\"ph\": \"" << event.phase << "\", \"name\": \"" << event.name << "\""
+               << ", \"pid\": 1, \"tid\": " << lane.tid() << ", \"ts\": ";
+            write_time(os, event.startNs);
+            switch (event.phase)
+            {
+                case 'X':
+                    os << ", \"dur\": ";
+                    write_time(os, event.durationNs);
+                    break;
+                case 'i':
+                    os << ", \"s\": \"t\"";
+                    break;
+                default:  // Flow
+                    os << ", \"cat\": \"job\", \"id\": \"" << event.stream << ":" << event.sequence << "\", \"bp\": \"e\"";
+                    break;
+            }
+            os << ", \"args\": {\"stream\": " << event.stream << ", \"seq\": " << event.sequence;
+            if (event.argName)
+            {
+                os << ", \"" << event.argName << "\": " << event.arg;
+            }
+            os << "}}";
+        }
+    }
+    os << std::endl << "]}" << std::endl;
+}
+
+
+inline void JobTracer::write_time(std::ostream& os, uint64_t ns)
+{
+    os << ns / 1000 << "." << std::setw(3) << std::setfill('0') << ns % 1000 << std::setfill(' ');
+}
+
+
+} // End namespace
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef JS_MAPPEDFEEDER_H
+#define JS_MAPPEDFEEDER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "feeder.hpp"
+
+
+namespace job_scheduler
+{
+
+
+/** Read only memory mapping of a whole file (POSIX). The file is not copied:
+  * the pages are loaded by the kernel when accessed.
+  */
+class MappedFile
+{
+public:
+    /** Throw std::system_error if the file cannot be opened or mapped
+      */
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* data() const;  // nullptr for an empty file
+    size_t size() const;
+
+    /** madvise on the pages containing [offset, offset + length) (the range is
+      * clamped to the file). Only a hint: the errors are ignored
+      */
+    void advise(size_t offset, size_t length, int advice) const;
+
+private:
+    const char* _data;
+    size_t _size;
+};
+
+
+/** Record given to the workers by the MappedFeeder: points directly into the
+  * mapping (no copy). The mapping stays valid as long as a view exists.
+  */
+struct RecordView
+{
+    const char* data;
+    size_t size;
+    size_t offset;  // Position of the record in the file
+    std::shared_ptr<const MappedFile> file;  // Keep the mapping alive
+};
+
+
+/** How the file is split into records
+  */
+enum class RecordFormat
+{
+    FIXED_SIZE,  // Records of recordSize bytes
+    LENGTH_PREFIXED,  // uint32_t little endian size followed by the record
+    DELIMITED  // Records separated by the delimiter (not included in the record). The last delimiter is optional
+};
+
+
+// Default number of bytes prefetched ahead of the MappedFeeder position
+constexpr size_t DEFAULT_READAHEAD = 8 * 1024 * 1024;
+
+
+/** Batch feeder (see FeedStatus) which splits a memory mapped file into
+  * records and gives a RecordView of each of them as input, so multi-GB files
+  * can be processed without being copied into user space buffers.
+  * The mapping is read sequentially (MADV_SEQUENTIAL): the pages ahead of the
+  * last record pushed in the input queue are prefetched (MADV_WILLNEED), so
+  * the readahead follows the consumption of the input queue. A truncated last
+  * record (FIXED_SIZE or LENGTH_PREFIXED) ends the stream with
+  * FeedStatus::ERROR.
+  * POSIX only, so not included by job_scheduler.hpp.
+  *
+  *   QueueScheduler<LineCounter> queue{64};  // Worker with operator()(const RecordView&)
+  *   queue.launch(MappedFeeder::delimited("video.idx", '\n'));
+  */
+class MappedFeeder
+{
+public:
+    /** Throw std::system_error if the file cannot be mapped, and
+      * std::invalid_argument if recordSize is 0
+      */
+    static MappedFeeder fixed_size(const std::string& path, size_t recordSize);
+    static MappedFeeder length_prefixed(const std::string& path);
+    static MappedFeeder delimited(const std::string& path, char delimiter = '\n');
+
+    /** Number of bytes prefetched ahead of the feeder position (0 to
+      * disable the prefetch)
+      */
+    void set_readahead(size_t nbBytes);
+
+    FeedStatus operator()(std::vector<std::unique_ptr<RecordView>>& inputs, size_t maxInputs);
+
+    const MappedFile& file() const;
+
+private:
+    MappedFeeder(const std::string& path, RecordFormat format, size_t recordSize, char delimiter);
+
+    // Size of the record at _position, and of its prefix (header) and
+    // delimiter (footer). Return false if the record is truncated
+    bool next_record(size_t& header, size_t& recordSize, size_t& footer) const;
+
+    void prefetch();  // Advise the readahead window ahead of _position
+
+    std::shared_ptr<const MappedFile> _file;
+    RecordFormat _format;
+    size_t _recordSize;
+    char _delimiter;
+
+    size_t _position;  // Beginning of the next record
+    size_t _readahead;
+    size_t _prefetchEnd;  // End of the range already advised
+};
+
+
+inline MappedFile::MappedFile(const std::string& path) :
+    _data(nullptr),
+    _size(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "Cannot stat " + path);
+    }
+    _size = static_cast<size_t>(info.st_size);
+
+    if (_size > 0)  // mmap fails on an empty range
+    {
+        void* data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "Cannot map " + path);
+        }
+        _data = static_cast<const char*>(data);
+    }
+    ::close(fd);  // The mapping keeps its own reference to the file
+}
+
+
+inline MappedFile::~MappedFile()
+{
+    if (_data)
+    {
+        ::munmap(const_cast<char*>(_data), _size);
+    }
+}
+
+
+inline const char* MappedFile::data() const
+{
+    return _data;
+}
+
+
+inline size_t MappedFile::size() const
+{
+    return _size;
+}
+
+
+inline void MappedFile::advise(size_t offset, size_t length, int advice) const
+{
+    if (!_data || offset >= _size)
+    {
+        return;
+    }
+    static const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t begin = offset - offset % pageSize;  // madvise requires an aligned address
+    size_t end = std::min(offset + length, _size);
+    ::madvise(const_cast<char*>(_data) + begin, end - begin, advice);
+}
+
+
+inline MappedFeeder MappedFeeder::fixed_size(const std::string& path, size_t recordSize)
+{
+    if (recordSize == 0)
+    {
+        throw std::invalid_argument("MappedFeeder: the records require a size > 0");
+    }
+    return MappedFeeder(path, RecordFormat::FIXED_SIZE, recordSize, '\0');
+}
+
+
+inline MappedFeeder MappedFeeder::length_prefixed(const std::string& path)
+{
+    return MappedFeeder(path, RecordFormat::LENGTH_PREFIXED, 0, '\0');
+}
+
+
+inline MappedFeeder MappedFeeder::delimited(const std::string& path, char delimiter)
+{
+    return MappedFeeder(path, RecordFormat::DELIMITED, 0, delimiter);
+}
+
+
+inline MappedFeeder::MappedFeeder(const std::string& path, RecordFormat format, size_t recordSize, char delimiter) :
+    _file(std::make_shared<const MappedFile>(path)),
+    _format(format),
+    _recordSize(recordSize),
+    _delimiter(delimiter),
+    _position(0),
+    _readahead(DEFAULT_READAHEAD),
+    _prefetchEnd(0)
+{
+    _file->advise(0, _file->size(), MADV_SEQUENTIAL);
+}
+
+
+inline void MappedFeeder::set_readahead(size_t nbBytes)
+{
+    _readahead = nbBytes;
+}
+
+
+inline FeedStatus MappedFeeder::operator()(std::vector<std::unique_ptr<RecordView>>& inputs, size_t maxInputs)
+{
+    prefetch();
+
+    const size_t fileSize = _file->size();
+    while (inputs.size() < maxInputs && _position < fileSize)
+    {
+        size_t header = 0;
+        size_t recordSize = 0;
+        size_t footer = 0;
+        if (!next_record(header, recordSize, footer))
+        {
+            _position = fileSize;
+            return FeedStatus::ERROR;  // The inputs already filled are still processed
+        }
+
+        size_t offset = _position + header;
+        inputs.emplace_back(new RecordView{_file->data() + offset, recordSize, offset, _file});
+        _position = offset + recordSize + footer;
+    }
+    return _position < fileSize ? FeedStatus::MORE : FeedStatus::END;
+}
+
+
+inline const MappedFile& MappedFeeder::file() const
+{
+    return *_file;
+}
+
+
+inline bool MappedFeeder::next_record(size_t& header, size_t& recordSize, size_t& footer) const
+{
+    const char* begin = _file->data() + _position;
+    size_t remaining = _file->size() - _position;
+    switch (_format)
+    {
+        case RecordFormat::FIXED_SIZE:
+            recordSize = _recordSize;
+            return recordSize <= remaining;
+        case RecordFormat::LENGTH_PREFIXED:
+        {
+            header = sizeof(uint32_t);
+            if (remaining < header)
+            {
+                return false;
+            }
+            const unsigned char* prefix = reinterpret_cast<const unsigned char*>(begin);
+            recordSize = static_cast<size_t>(prefix[0]) | static_cast<size_t>(prefix[1]) << 8 |
+                static_cast<size_t>(prefix[2]) << 16 | static_cast<size_t>(prefix[3]) << 24;
+            return recordSize <= remaining - header;
+        }
+        case RecordFormat::DELIMITED:
+        {
+            const void* delimiter = std::memchr(begin, _delimiter, remaining);
+            recordSize = delimiter ? static_cast<const char*>(delimiter) - begin : remaining;
+            footer = delimiter ? 1 : 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+inline void MappedFeeder::prefetch()
+{
+    // Only advise again once half of the window has been consumed (one system
+    // call every readahead/2 bytes instead of one per batch)
+    if (_readahead == 0 || _position + _readahead / 2 < _prefetchEnd)
+    {
+        return;
+    }
+    size_t begin = std::max(_position, _prefetchEnd);
+    size_t end = _position + _readahead;
+    _file->advise(begin, end - begin, MADV_WILLNEED);
+    _prefetchEnd = end;
+}
+
+
+} // End namespace
+
+#endif
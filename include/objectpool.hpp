@@ -0,0 +1,201 @@
+#ifndef JS_OBJECTPOOL_H
+#define JS_OBJECTPOOL_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "queuethread.hpp"
+
+
+namespace job_scheduler
+{
+
+
+/** Thread safe pool of recycled objects (ex: large frame buffers)
+  * The acquire call return a previously released object if any, otherwise
+  * build a new one. The released objects are kept for a future acquire (at
+  * most maxCached of them, the others are deleted), so in steady state, no
+  * allocation is done.
+  * The recycled objects are not reset: the caller of acquire has to
+  * overwrite their content.
+  */
+template <typename T>
+class ObjectPool
+{
+public:
+    using Builder = std::function<std::unique_ptr<T>()>;
+
+    /** By default, the objects are default constructed
+      */
+    ObjectPool(size_t maxCached = UNLIMITED, const Builder& builder = default_builder());
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+    ~ObjectPool() = default;
+
+    /** Return a recycled object, or a new one if the pool is empty
+      */
+    std::unique_ptr<T> acquire();
+
+    /** Give back the object to the pool. Nullptr are ignored
+      */
+    void release(std::unique_ptr<T> object);
+
+    /** Build objects until nbObjects are available in the pool
+      */
+    void reserve(size_t nbObjects);
+
+    /** WARNING: Not thread safe. Should be called before the pool is used
+      */
+    void set_builder(const Builder& builder);
+    void set_max_cached(size_t maxCached);
+
+    // Statistics (can be read from any thread)
+    size_t nb_allocations() const;  // Number of objects built
+    size_t nb_acquisitions() const;  // Number of acquire calls (allocated or recycled)
+    size_t nb_cached();  // Number of objects currently waiting in the pool
+
+private:
+    static Builder default_builder();
+    static Builder default_builder(std::true_type);  // T is default constructible
+    static Builder default_builder(std::false_type);
+
+    std::mutex _mutexPool;
+    std::vector<std::unique_ptr<T>> _objects;
+    size_t _maxCached;
+    Builder _builder;
+
+    std::atomic<size_t> _nbAllocations;
+    std::atomic<size_t> _nbAcquisitions;
+};
+
+
+template <typename T>
+ObjectPool<T>::ObjectPool(size_t maxCached, const Builder& builder) :
+    _mutexPool(),
+    _objects(),
+    _maxCached(maxCached),
+    _builder(builder),
+    _nbAllocations(0),
+    _nbAcquisitions(0)
+{
+}
+
+
+template <typename T>
+std::unique_ptr<T> ObjectPool<T>::acquire()
+{
+    ++_nbAcquisitions;
+    {
+        std::lock_guard<std::mutex> guard(_mutexPool);
+        if (!_objects.empty())
+        {
+            std::unique_ptr<T> object = std::move(_objects.back());
+            _objects.pop_back();
+            return object;
+        }
+    }
+
+    // Build outside the lock (can be expensive)
+    ++_nbAllocations;
+    return _builder();
+}
+
+
+template <typename T>
+void ObjectPool<T>::release(std::unique_ptr<T> object)
+{
+    if (!object)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(_mutexPool);
+    if (_maxCached == UNLIMITED || _objects.size() < _maxCached)
+    {
+        _objects.push_back(std::move(object));
+    }
+    // Otherwise the object is deleted
+}
+
+
+template <typename T>
+void ObjectPool<T>::reserve(size_t nbObjects)
+{
+    std::lock_guard<std::mutex> guard(_mutexPool);
+    _objects.reserve(nbObjects);
+    while (_objects.size() < nbObjects)
+    {
+        ++_nbAllocations;
+        _objects.push_back(_builder());
+    }
+}
+
+
+template <typename T>
+void ObjectPool<T>::set_builder(const Builder& builder)
+{
+    _builder = builder;
+}
+
+
+template <typename T>
+void ObjectPool<T>::set_max_cached(size_t maxCached)
+{
+    std::lock_guard<std::mutex> guard(_mutexPool);
+    _maxCached = maxCached;
+}
+
+
+template <typename T>
+size_t ObjectPool<T>::nb_allocations() const
+{
+    return _nbAllocations.load();
+}
+
+
+template <typename T>
+size_t ObjectPool<T>::nb_acquisitions() const
+{
+    return _nbAcquisitions.load();
+}
+
+
+template <typename T>
+size_t ObjectPool<T>::nb_cached()
+{
+    std::lock_guard<std::mutex> guard(_mutexPool);
+    return _objects.size();
+}
+
+
+template <typename T>
+auto ObjectPool<T>::default_builder() -> Builder
+{
+    return default_builder(std::is_default_constructible<T>{});
+}
+
+
+template <typename T>
+auto ObjectPool<T>::default_builder(std::true_type) -> Builder
+{
+    return []{ return std::unique_ptr<T>(new T()); };
+}
+
+
+template <typename T>
+auto ObjectPool<T>::default_builder(std::false_type) -> Builder
+{
+    return []() -> std::unique_ptr<T> {
+        throw std::logic_error("ObjectPool: the type is not default constructible, set_builder has to be called");
+    };
+}
+
+
+} // End namespace
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef JS_ORDEREDSINK_H
+#define JS_ORDEREDSINK_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <exception>
+#include <future>
+#include <memory>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "objectpool.hpp"
+
+
+namespace job_scheduler
+{
+
+
+/** Bytes of an output written by the OrderedSink. They are not copied: they
+  * have to stay valid as long as the output exists
+  */
+struct OutputBytes
+{
+    const void* data;
+    size_t size;
+};
+
+
+/** Default serializer of the OrderedSink: the content of outputs with
+  * contiguous data() and size() (ex: std::string, std::vector<char>)
+  */
+struct ContiguousBytes
+{
+    template <typename Output>
+    OutputBytes operator()(const Output& output) const
+    {
+        return OutputBytes{output.data(), output.size() * sizeof(*output.data())};
+    }
+};
+
+
+/** When the OrderedSink writes its pending outputs. The pending outputs are
+  * also written as soon as no other output is ready, so an output never waits
+  * for the next ones to be written
+  */
+struct SinkPolicy
+{
+    SinkPolicy(size_t maxOutputs = 64, size_t maxBytes = 1024 * 1024, bool sync = false) :
+        maxOutputs(maxOutputs), maxBytes(maxBytes), sync(sync)
+    {}
+
+    size_t maxOutputs;  // Flush once that many outputs are pending (1 to write each output as soon as popped)
+    size_t maxBytes;  // Flush once that many bytes are pending
+    bool sync;  // fdatasync after each flush
+};
+
+
+/** Drain the outputs of a source (QueueScheduler or StreamHandle) in order on
+  * its own thread (all the ready outputs are popped at once with pop_batch)
+  * and write them to a file descriptor. The pending outputs are written
+  * together with a single writev (see SinkPolicy) once the limits are reached
+  * or no other output is ready, so the consumption is not
+  * limited by one system call per output and does not occupy the thread which
+  * launched the scheduler.
+  *
+  *   QueueScheduler<Encoder> queue{};
+  *   queue.add_workers({}, 4);
+  *   queue.launch(VideoFeeder("vid.mp4"));
+  *   OrderedSink<QueueScheduler<Encoder>> sink{queue, fd};
+  *   sink.wait();  // All the outputs have been written
+  *
+  * The Serializer gives the OutputBytes of an output (ContiguousBytes by
+  * default).
+  * POSIX only (writev), so not included by job_scheduler.hpp.
+  */
+template <class Source, class Serializer = ContiguousBytes>
+class OrderedSink
+{
+public:
+    using OutputPtr = decltype(std::declval<Source&>().pop());
+    using Output = typename OutputPtr::element_type;
+
+    /** Start draining the source. The source and the file descriptor (not
+      * closed by the sink) have to outlive the sink. Once written, the outputs
+      * are given back to the pool if any (ex: &queue.output_pool()), deleted
+      * otherwise.
+      */
+    OrderedSink(
+        Source& source,
+        int fd,
+        const SinkPolicy& policy = SinkPolicy(),
+        ObjectPool<Output>* pool = nullptr,
+        Serializer serializer = Serializer()
+    );
+    OrderedSink(const OrderedSink&) = delete;
+    OrderedSink& operator=(const OrderedSink&) = delete;
+    ~OrderedSink();  // Wait for the end of the stream (the errors are ignored)
+
+    /** Block until the release token has been popped and all the outputs
+      * written. Rethrow the first error (thrown by pop, or std::system_error
+      * if a write failed). After an error, the remaining outputs are still
+      * popped (so the scheduler can finish) but not written.
+      * WARNING: Not thread safe
+      */
+    void wait();
+
+    // Can be read from any thread while the sink is running
+    size_t nb_outputs() const;  // Written
+    size_t nb_bytes() const;
+    size_t nb_writes() const;  // Number of system calls
+
+private:
+    void drain();  // Sink thread
+    void flush();  // Write the pending outputs. Throw std::system_error if the write fails
+    void release_pending();
+    void release(OutputPtr output);
+
+    Source& _source;
+    int _fd;
+    SinkPolicy _policy;
+    ObjectPool<Output>* _pool;
+    Serializer _serializer;
+    size_t _maxIovecs;  // Limit of a single writev call
+
+    std::vector<OutputPtr> _pending;  // Keep the written bytes alive
+    std::vector<iovec> _iovecs;
+    size_t _pendingBytes;
+
+    std::atomic<size_t> _nbOutputs;
+    std::atomic<size_t> _nbBytes;
+    std::atomic<size_t> _nbWrites;
+
+    std::future<void> _task;  // Launched once all the other members are constructed
+};
+
+
+template <class Source, class Serializer>
+OrderedSink<Source, Serializer>::OrderedSink(
+    Source& source,
+    int fd,
+    const SinkPolicy& policy,
+    ObjectPool<Output>* pool,
+    Serializer serializer
+) :
+    _source(source),
+    _fd(fd),
+    _policy(policy),
+    _pool(pool),
+    _serializer(std::move(serializer)),
+    _maxIovecs(1024),
+    _pending(),
+    _iovecs(),
+    _pendingBytes(0),
+    _nbOutputs(0),
+    _nbBytes(0),
+    _nbWrites(0),
+    _task()
+{
+    long maxIovecs = ::sysconf(_SC_IOV_MAX);
+    if (maxIovecs > 0)
+    {
+        _maxIovecs = static_cast<size_t>(maxIovecs);
+    }
+    _pending.reserve(std::min(_policy.maxOutputs, _maxIovecs));
+    _iovecs.reserve(std::min(_policy.maxOutputs, _maxIovecs));
+
+    _task = std::async(std::launch::async, &OrderedSink::drain, this);
+}
+
+
+template <class Source, class Serializer>
+OrderedSink<Source, Serializer>::~OrderedSink()
+{
+    if (_task.valid())
+    {
+        _task.wait();
+    }
+}
+
+
+template <class Source, class Serializer>
+void OrderedSink<Source, Serializer>::wait()
+{
+    if (_task.valid())
+    {
+        _task.get();
+    }
+}
+
+
+template <class Source, class Serializer>
+size_t OrderedSink<Source, Serializer>::nb_outputs() const
+{
+    return _nbOutputs.load();
+}
+
+
+template <class Source, class Serializer>
+size_t OrderedSink<Source, Serializer>::nb_bytes() const
+{
+    return _nbBytes.load();
+}
+
+
+template <class Source, class Serializer>
+size_t OrderedSink<Source, Serializer>::nb_writes() const
+{
+    return _nbWrites.load();
+}
+
+
+template <class Source, class Serializer>
+void OrderedSink<Source, Serializer>::drain()
+{
+    std::exception_ptr error;
+    std::vector<OutputPtr> batch;  // All the outputs ready, popped at once
+    bool released = false;
+    while (!released)
+    {
+        batch.clear();
+        size_t maxBatch = _policy.maxOutputs > _pending.size() ? _policy.maxOutputs - _pending.size() : 1;
+        try
+        {
+            _source.pop_batch(batch, maxBatch);
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+                try
+                {
+                    flush();  // The pending outputs are before the error
+                }
+                catch (...)
+                {
+                    release_pending();
+                }
+            }
+            continue;  // Wait for the release token
+        }
+
+        for (OutputPtr& output : batch)
+        {
+            if (!output)  // Release token (always the last one)
+            {
+                released = true;
+                break;
+            }
+            if (error)
+            {
+                release(std::move(output));
+                continue;
+            }
+
+            OutputBytes bytes = _serializer(*output);
+            if (bytes.size > 0)
+            {
+                _iovecs.push_back(iovec{const_cast<void*>(bytes.data), bytes.size});
+                _pendingBytes += bytes.size;
+            }
+            _pending.push_back(std::move(output));
+
+            if (_pending.size() >= _policy.maxOutputs || _pendingBytes >= _policy.maxBytes)
+            {
+                try
+                {
+                    flush();
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+
+        // Nothing more ready right away (pop_batch returned all the releasable
+        // outputs): do not hold the outputs already in order until the next
+        // ones, which could come much later on a slow or live stream
+        if (!released && !error && !_pending.empty() && batch.size() < maxBatch)
+        {
+            try
+            {
+                flush();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if (!error)
+    {
+        flush();  // Rethrown by wait()
+    }
+    else
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+
+template <class Source, class Serializer>
+void OrderedSink<Source, Serializer>::flush()
+{
+    size_t first = 0;  // First iovec not entirely written
+    while (first < _iovecs.size())
+    {
+        int count = static_cast<int>(std::min(_iovecs.size() - first, _maxIovecs));
+        ssize_t written = ::writev(_fd, &_iovecs[first], count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            int writeError = errno;
+            release_pending();
+            throw std::system_error(writeError, std::generic_category(), "OrderedSink cannot write the outputs");
+        }
+        if (written == 0)  // Nothing written while bytes are pending: retrying would never end
+        {
+            release_pending();
+            throw std::system_error(EIO, std::generic_category(), "OrderedSink cannot write the outputs (nothing written)");
+        }
+        ++_nbWrites;
+        _nbBytes += static_cast<size_t>(written);
+
+        // Partial write: skip the written iovecs and resume inside the last one
+        size_t remaining = static_cast<size_t>(written);
+        while (first < _iovecs.size() && remaining >= _iovecs[first].iov_len)
+        {
+            remaining -= _iovecs[first].iov_len;
+            ++first;
+        }
+        if (remaining > 0)
+        {
+            _iovecs[first].iov_base = static_cast<char*>(_iovecs[first].iov_base) + remaining;
+            _iovecs[first].iov_len -= remaining;
+        }
+    }
+
+    if (_policy.sync && !_pending.empty() && ::fdatasync(_fd) != 0)
+    {
+        int syncError = errno;
+        release_pending();
+        throw std::system_error(syncError, std::generic_category(), "OrderedSink cannot sync the outputs");
+    }
+    _nbOutputs += _pending.size();
+    release_pending();
+}
+
+
+template <class Source, class Serializer>
+void OrderedSink<Source, Serializer>::release_pending()
+{
+    for (OutputPtr& output : _pending)
+    {
+        release(std::move(output));
+    }
+    _pending.clear();
+    _iovecs.clear();
+    _pendingBytes = 0;
+}
+
+
+template <class Source, class Serializer>
+void OrderedSink<Source, Serializer>::release(OutputPtr output)
+{
+    if (_pool)
+    {
+        _pool->release(std::move(output));
+    }
+}
+
+
+} // End namespace
+
+#endif
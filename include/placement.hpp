@@ -0,0 +1,235 @@
+#ifndef JS_PLACEMENT_H
+#define JS_PLACEMENT_H
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace job_scheduler
+{
+
+
+/** Ids of logical cores, as numbered by the kernel
+  */
+using CpuSet = std::vector<int>;
+
+
+/** Cores the calling thread is allowed to run on (sorted). Outside Linux,
+  * all the cores reported by std::thread::hardware_concurrency
+  */
+inline CpuSet allowed_cpus();
+
+/** Allowed cores of each NUMA node (the nodes without allowed core are
+  * skipped). A single node with all the allowed cores on a non NUMA machine
+  * or outside Linux.
+  */
+inline std::vector<CpuSet> numa_nodes();
+
+/** Restrict the calling thread to the given cores. Return false (and leave
+  * the thread unchanged) if the set is empty, or if pinning is not supported
+  * (outside Linux) or has failed (ex: core not allowed)
+  */
+inline bool pin_current_thread(const CpuSet& cpus);
+
+/** Core currently running the calling thread (-1 if unknown)
+  */
+inline int current_cpu();
+
+
+/** Where the threads of a QueueScheduler run (see set_placement). An empty
+  * set (or an empty workerCpus function) leaves the threads unpinned.
+  */
+struct PlacementPolicy
+{
+    PlacementPolicy() :
+        workerCpus(), feederCpus(), schedulerCpus()
+    {}
+
+    /** Each worker pinned to its own core (worker id modulo the number of
+      * cores), so its cache and TLB stay warm between two jobs
+      */
+    static PlacementPolicy per_core(const CpuSet& cpus = allowed_cpus());
+
+    /** The workers spread over the NUMA nodes (worker id modulo the number of
+      * nodes), each one free to move between the cores of its node, so its
+      * memory stays local. No-op with a single node.
+      */
+    static PlacementPolicy per_node(const std::vector<CpuSet>& nodes = numa_nodes());
+
+    std::function<CpuSet(int)> workerCpus;  // Cores of a worker id
+    CpuSet feederCpus;  // Cores of the feeder threads
+    CpuSet schedulerCpus;  // Cores of the scheduler threads (and of the autoscaling and hedging threads)
+};
+
+
+namespace detail
+{
+
+/** Parse a kernel cpu list (ex: "0-3,8,10-11"). Empty if it cannot be read
+  */
+inline CpuSet read_cpu_list(const std::string& path)
+{
+    CpuSet cpus;
+    std::ifstream file(path);
+    std::string list;
+    if (!std::getline(file, list))
+    {
+        return cpus;
+    }
+
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        size_t dash = range.find('-');
+        try
+        {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first ; cpu <= last ; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (const std::exception&)  // Empty or malformed list
+        {
+            return CpuSet();
+        }
+    }
+    return cpus;
+}
+
+} // End namespace detail
+
+
+inline CpuSet allowed_cpus()
+{
+    CpuSet cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0 ; cpu < CPU_SETSIZE ; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty())
+    {
+        unsigned nbCpus = std::thread::hardware_concurrency();
+        for (unsigned cpu = 0 ; cpu < (nbCpus > 0 ? nbCpus : 1) ; ++cpu)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+
+inline std::vector<CpuSet> numa_nodes()
+{
+    CpuSet allowed = allowed_cpus();
+    std::vector<CpuSet> nodes;
+#ifdef __linux__
+    for (int node : detail::read_cpu_list("/sys/devices/system/node/online"))
+    {
+        CpuSet cpus;
+        for (int cpu : detail::read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"))
+        {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty())  // Memory only node, or no core allowed
+        {
+            nodes.push_back(cpus);
+        }
+    }
+#endif
+    if (nodes.empty())
+    {
+        nodes.push_back(allowed);
+    }
+    return nodes;
+}
+
+
+inline bool pin_current_thread(const CpuSet& cpus)
+{
+    if (cpus.empty())
+    {
+        return false;
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+
+inline int current_cpu()
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+
+inline PlacementPolicy PlacementPolicy::per_core(const CpuSet& cpus)
+{
+    PlacementPolicy policy;
+    if (!cpus.empty())
+    {
+        policy.workerCpus = [cpus](int workerId) {
+            size_t index = static_cast<size_t>(workerId >= 0 ? workerId : -workerId) % cpus.size();
+            return CpuSet{cpus[index]};
+        };
+    }
+    return policy;
+}
+
+
+inline PlacementPolicy PlacementPolicy::per_node(const std::vector<CpuSet>& nodes)
+{
+    PlacementPolicy policy;
+    if (nodes.size() > 1)  // Nothing to gain on a single node
+    {
+        policy.workerCpus = [nodes](int workerId) {
+            return nodes[static_cast<size_t>(workerId >= 0 ? workerId : -workerId) % nodes.size()];
+        };
+    }
+    return policy;
+}
+
+
+} // End namespace
+
+#endif
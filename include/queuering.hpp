@@ -0,0 +1,472 @@
+#ifndef JS_QUEUERING_H
+#define JS_QUEUERING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "queuethread.hpp"
+
+
+namespace job_scheduler
+{
+
+// Size used to pad the data shared between threads (avoid false sharing)
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Maximum size of the ring queues when the maxSize is UNLIMITED (a ring is always bounded)
+constexpr size_t DEFAULT_RING_SIZE = 1024;
+
+
+/** Concurrency allowed on a QueueRing
+  */
+enum class RingMode
+{
+    SPSC,  // Only one thread push and only one thread pop at a time
+    MPMC  // Any thread can push or pop
+};
+
+
+/** Thread safe queue implementation based on a preallocated ring buffer.
+  * Has the same push_back/pop_front semantic as QueueThread but the push and pop
+  * calls don't lock any mutex (and don't allocate) while the queue is neither
+  * empty nor full. Only in that case, the calls spin a little and then block
+  * (the pop calls follow the WaitPolicy of the queue, see set_wait_policy).
+  * The queue holds at most maxSize elements, as QueueThread (the cells are
+  * allocated for the next power of two). WARNING: If maxSize is UNLIMITED, the
+  * queue is still bounded to DEFAULT_RING_SIZE elements (the push calls block
+  * beyond).
+  * Contrary to QueueThread, there is no pop_select (the elements can only be
+  * popped in order) and size is only an estimate while the queue is used.
+  * In SPSC mode, the pushes (and the pops) have to be done sequencially (from
+  * a single thread, or with an external synchronisation).
+  * Based on the bounded MPMC queue from Dmitry Vyukov.
+  */
+template <typename T, RingMode mode>
+class QueueRing
+{
+public:
+    QueueRing(size_t maxSize = UNLIMITED);
+    QueueRing(const QueueRing&) = delete;
+    QueueRing& operator=(const QueueRing&) = delete;
+    ~QueueRing();
+
+    void push_back(const T& elem);
+    void push_back(T&& elem);
+
+    /** Push all the elements, in order, and wake up the pop calls once. The
+      * elements are moved and elems is cleared
+      */
+    void push_batch(std::vector<T>& elems);
+
+    T pop_front();
+
+    /** Same as pop_front but wait at most for the given duration. Return false
+      * if the queue is still empty
+      */
+    template <class Rep, class Period>
+    bool pop_for(T& elem, const std::chrono::duration<Rep, Period>& timeout);
+
+    /** Same as pop_front but never wait. Return false if the queue is empty
+      * (elem is unchanged)
+      */
+    bool try_pop(T& elem);
+
+    /** Block while the queue is empty, then append all the available elements
+      * (at most maxElems) to elems. Return the number of elements popped
+      */
+    size_t pop_batch(std::vector<T>& elems, size_t maxElems);
+
+    /** Number of elements currently in the queue (can already be outdated if
+      * other threads push or pop)
+      */
+    size_t size() const;
+
+    size_t capacity() const;  // Maximum number of elements
+
+    /** How the pop calls wait for an element (see WaitPolicy). By default,
+      * NB_SPIN yields before blocking.
+      * WARNING: Not thread safe. Should be called while no pop call is waiting
+      */
+    void set_wait_policy(const WaitPolicy& policy);
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;  // Indicate if the cell is ready to be pushed or popped
+        T data;
+    };
+
+    /** Each cell is stored on its own cache line
+      */
+    struct alignas(CACHE_LINE_SIZE) PaddedCell : public Cell
+    {
+    };
+
+    // Non blocking versions. Return false if the queue is full/empty
+    template <typename U>
+    bool try_push(U&& elem);
+    bool try_pop_cell(T& elem);
+
+    void notify(std::atomic<size_t>& nbWaiting, std::condition_variable& cv);
+
+    static size_t round_capacity(size_t maxSize);
+
+    static constexpr int NB_SPIN = 64;  // Number of tries before blocking
+
+    const size_t _maxSize;  // Never UNLIMITED
+    const size_t _mask;  // Number of cells - 1
+    std::unique_ptr<char[]> _buffer;  // Raw memory of the cells
+    PaddedCell* _cells;
+
+    char _pad0[CACHE_LINE_SIZE];
+    std::atomic<size_t> _tail;  // Next position to push
+    char _pad1[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> _head;  // Next position to pop
+    char _pad2[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    WaitPolicy _waitPolicy;  // Of the pop calls
+
+    // Only used when the queue is empty or full
+    std::atomic<size_t> _nbWaitingPush;
+    std::atomic<size_t> _nbWaitingPop;
+    std::mutex _mutexWait;
+    std::condition_variable _cvEmpty;
+    std::condition_variable _cvFull;
+};
+
+
+template <typename T>
+using QueueRingSPSC = QueueRing<T, RingMode::SPSC>;
+
+template <typename T>
+using QueueRingMPMC = QueueRing<T, RingMode::MPMC>;
+
+
+template <typename T, RingMode mode>
+QueueRing<T, mode>::QueueRing(size_t maxSize) :
+    _maxSize(maxSize == UNLIMITED ? DEFAULT_RING_SIZE : maxSize),
+    _mask(round_capacity(_maxSize) - 1),
+    _buffer(new char[(_mask + 1) * sizeof(PaddedCell) + CACHE_LINE_SIZE]),
+    _cells(nullptr),
+    _tail(0),
+    _head(0),
+    _waitPolicy(WaitStrategy::SPIN_THEN_BLOCK, 0, NB_SPIN),
+    _nbWaitingPush(0),
+    _nbWaitingPop(0),
+    _mutexWait(),
+    _cvEmpty(),
+    _cvFull()
+{
+    // Align the cells on a cache line (the default new does not guarantee it before c++17)
+    void* memory = _buffer.get();
+    size_t space = (_mask + 1) * sizeof(PaddedCell) + CACHE_LINE_SIZE;
+    _cells = static_cast<PaddedCell*>(std::align(CACHE_LINE_SIZE, (_mask + 1) * sizeof(PaddedCell), memory, space));
+
+    for (size_t i = 0 ; i <= _mask ; ++i)
+    {
+        new (&_cells[i]) PaddedCell();
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+
+template <typename T, RingMode mode>
+QueueRing<T, mode>::~QueueRing()
+{
+    for (size_t i = 0 ; i <= _mask ; ++i)
+    {
+        _cells[i].~PaddedCell();
+    }
+}
+
+
+template <typename T, RingMode mode>
+void QueueRing<T, mode>::push_back(const T& elem)
+{
+    T copy(elem);
+    push_back(std::move(copy));
+}
+
+
+template <typename T, RingMode mode>
+void QueueRing<T, mode>::push_back(T&& elem)
+{
+    for (int i = 0 ; i < NB_SPIN ; ++i)
+    {
+        if (try_push(std::move(elem)))  // The element is only moved on success
+        {
+            notify(_nbWaitingPop, _cvEmpty);  // Eventually unlock pop_front
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    // The queue is full
+    {
+        std::unique_lock<std::mutex> guard(_mutexWait);
+        _nbWaitingPush.fetch_add(1);
+        _cvFull.wait(guard, [this, &elem]{ return this->try_push(std::move(elem)); });
+        _nbWaitingPush.fetch_sub(1);
+    }
+    notify(_nbWaitingPop, _cvEmpty);
+}
+
+
+template <typename T, RingMode mode>
+void QueueRing<T, mode>::push_batch(std::vector<T>& elems)
+{
+    for (T& elem : elems)
+    {
+        if (!try_push(std::move(elem)))
+        {
+            notify(_nbWaitingPop, _cvEmpty);  // The queue is full: release the elements already pushed before blocking
+            push_back(std::move(elem));
+        }
+    }
+    notify(_nbWaitingPop, _cvEmpty);
+    elems.clear();
+}
+
+
+template <typename T, RingMode mode>
+T QueueRing<T, mode>::pop_front()
+{
+    T elem;
+    for (size_t i = 0 ; ; ++i)
+    {
+        if (try_pop_cell(elem))
+        {
+            notify(_nbWaitingPush, _cvFull);  // Eventually unlock push_back
+            return elem;
+        }
+        if (!detail::spin_pause(_waitPolicy, i))
+        {
+            break;
+        }
+    }
+
+    // The queue is empty
+    {
+        std::unique_lock<std::mutex> guard(_mutexWait);
+        _nbWaitingPop.fetch_add(1);
+        _cvEmpty.wait(guard, [this, &elem]{ return this->try_pop_cell(elem); });
+        _nbWaitingPop.fetch_sub(1);
+    }
+    notify(_nbWaitingPush, _cvFull);
+    return elem;
+}
+
+
+template <typename T, RingMode mode>
+template <class Rep, class Period>
+bool QueueRing<T, mode>::pop_for(T& elem, const std::chrono::duration<Rep, Period>& timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (size_t i = 0 ; ; ++i)
+    {
+        if (try_pop_cell(elem))
+        {
+            notify(_nbWaitingPush, _cvFull);
+            return true;
+        }
+        if (!detail::spin_pause(_waitPolicy, i) || std::chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+    }
+
+    bool popped = false;
+    {
+        std::unique_lock<std::mutex> guard(_mutexWait);
+        _nbWaitingPop.fetch_add(1);
+        popped = _cvEmpty.wait_until(guard, deadline, [this, &elem]{ return this->try_pop_cell(elem); });
+        _nbWaitingPop.fetch_sub(1);
+    }
+    if (popped)
+    {
+        notify(_nbWaitingPush, _cvFull);
+    }
+    return popped;
+}
+
+
+template <typename T, RingMode mode>
+bool QueueRing<T, mode>::try_pop(T& elem)
+{
+    if (!try_pop_cell(elem))
+    {
+        return false;
+    }
+    notify(_nbWaitingPush, _cvFull);
+    return true;
+}
+
+
+template <typename T, RingMode mode>
+size_t QueueRing<T, mode>::pop_batch(std::vector<T>& elems, size_t maxElems)
+{
+    if (maxElems == 0)
+    {
+        return 0;
+    }
+    elems.push_back(pop_front());  // Will wait for the first element
+
+    size_t nbPopped = 1;
+    T elem;
+    while (nbPopped < maxElems && try_pop_cell(elem))
+    {
+        elems.push_back(std::move(elem));
+        ++nbPopped;
+    }
+    if (nbPopped > 1)
+    {
+        notify(_nbWaitingPush, _cvFull);
+    }
+    return nbPopped;
+}
+
+
+template <typename T, RingMode mode>
+size_t QueueRing<T, mode>::size() const
+{
+    size_t head = _head.load(std::memory_order_acquire);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;  // A pop can have been reserved before its push completed
+}
+
+
+template <typename T, RingMode mode>
+size_t QueueRing<T, mode>::capacity() const
+{
+    return _maxSize;
+}
+
+
+template <typename T, RingMode mode>
+void QueueRing<T, mode>::set_wait_policy(const WaitPolicy& policy)
+{
+    _waitPolicy = policy;
+}
+
+
+template <typename T, RingMode mode>
+template <typename U>
+bool QueueRing<T, mode>::try_push(U&& elem)
+{
+    size_t pos = _tail.load(std::memory_order_relaxed);
+    PaddedCell* cell = nullptr;
+    while (true)
+    {
+        cell = &_cells[pos & _mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0)  // The cell is free
+        {
+            std::ptrdiff_t size = static_cast<std::ptrdiff_t>(pos - _head.load(std::memory_order_acquire));
+            if (size >= static_cast<std::ptrdiff_t>(_maxSize))  // The cells beyond maxSize are not used
+            {
+                return false;
+            }
+            if (mode == RingMode::SPSC)
+            {
+                _tail.store(pos + 1, std::memory_order_relaxed);
+                break;
+            }
+            if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)  // The cell has not been popped yet
+        {
+            return false;
+        }
+        else  // Another thread pushed on the cell
+        {
+            pos = _tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->data = std::forward<U>(elem);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+
+template <typename T, RingMode mode>
+bool QueueRing<T, mode>::try_pop_cell(T& elem)
+{
+    size_t pos = _head.load(std::memory_order_relaxed);
+    PaddedCell* cell = nullptr;
+    while (true)
+    {
+        cell = &_cells[pos & _mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0)  // The cell has been filled
+        {
+            if (mode == RingMode::SPSC)
+            {
+                _head.store(pos + 1, std::memory_order_relaxed);
+                break;
+            }
+            if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)  // The queue is empty
+        {
+            return false;
+        }
+        else  // Another thread popped the cell
+        {
+            pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+
+    elem = std::move(cell->data);
+    cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+
+template <typename T, RingMode mode>
+void QueueRing<T, mode>::notify(std::atomic<size_t>& nbWaiting, std::condition_variable& cv)
+{
+    // The fence ensure that either the waiting thread see the update, or we see
+    // the waiting thread
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (nbWaiting.load() > 0)
+    {
+        std::lock_guard<std::mutex> guard(_mutexWait);  // The waiting thread is either before the predicate or inside wait
+        cv.notify_all();
+    }
+}
+
+
+template <typename T, RingMode mode>
+size_t QueueRing<T, mode>::round_capacity(size_t maxSize)
+{
+    if (maxSize == UNLIMITED)
+    {
+        maxSize = DEFAULT_RING_SIZE;
+    }
+    size_t capacity = 2;
+    while (capacity < maxSize)
+    {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+
+} // End namespace
+
+#endif
@@ -1,70 +1,481 @@
 #ifndef JS_QUEUESCHEDULER_H
 #define JS_QUEUESCHEDULER_H
 
+#include <algorithm>
+#include <atomic>
 #include <list>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <future>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 #include <type_traits>
+#include <utility>
 
 #include "workerbase.hpp"
+#include "workertraits.hpp"
 #include "workerfactory.hpp"
+#include "feeder.hpp"
 #include "queuethread.hpp"
+#include "queuering.hpp"
+#include "reorderbuffer.hpp"
+#include "objectpool.hpp"
+#include "schedulerstats.hpp"
+#include "jobtracer.hpp"
+#include "placement.hpp"
 
 
 namespace job_scheduler
 {
 
 
+/** Strategy used to execute the jobs on the workers
+  */
+enum class DispatchMode
+{
+    ASYNC,  // A new thread is launched (std::async) for each job
+    POOL,  // Each worker owns a long-lived thread which process the jobs it receives
+    WORK_STEALING  // Same as POOL but the idle workers steal the jobs of the others or pull the inputs themselves (no dispatch by the scheduler thread)
+};
+
+
+/** Handoffs between the threads of a QueueScheduler (see set_wait_policy)
+  */
+enum class Handoff
+{
+    INPUTS,  // Scheduler waiting for the feeder (input queue of the streams)
+    WORKERS,  // Scheduler waiting for an idle worker (ASYNC and POOL mode)
+    JOBS,  // Worker thread waiting for its next job (POOL mode)
+    OUTPUTS  // pop calls waiting for the next output
+};
+
+
+/** Result of QueueScheduler::pop(JobStatus&)
+  */
+enum class JobStatus
+{
+    DONE,  // Output of the next job
+    DROPPED,  // The next job expired before being processed (no output, see set_ttl)
+    RELEASED  // Release token (end of the stream)
+};
+
+
+/** When the QueueScheduler adds or retires workers (see set_autoscaling).
+  * Every interval, the number of inputs waiting (in the input queues, and in
+  * the local queues in WORK_STEALING mode) and the number of idle workers are
+  * sampled. A worker is added after nbSamples consecutive samples with at
+  * least scaleUpDepth inputs waiting more than the idle workers can take (a
+  * worker is idle for a short time between two jobs). An idle worker is
+  * retired after nbSamples consecutive samples without input waiting and
+  * with more than scaleDownIdle of the workers idle. The distinct conditions
+  * and the consecutive samples are the hysteresis: a short burst or pause
+  * doesn't change the pool, and the pool doesn't oscillate.
+  */
+struct ScalingPolicy
+{
+    ScalingPolicy(size_t minWorkers = 1, size_t maxWorkers = 8) :
+        minWorkers(minWorkers), maxWorkers(maxWorkers), scaleUpDepth(1), scaleDownIdle(0.5),
+        nbSamples(10), interval(std::chrono::milliseconds(10))
+    {}
+
+    size_t minWorkers;
+    size_t maxWorkers;
+    size_t scaleUpDepth;  // Number of inputs waiting (beyond the idle workers) to add a worker
+    double scaleDownIdle;  // Fraction of idle workers to retire one
+    size_t nbSamples;  // Consecutive samples required for a change
+    std::chrono::milliseconds interval;  // Between two samples
+};
+
+
+/** How the QueueScheduler chooses between the idle workers (see set_routing)
+  */
+struct RoutingPolicy
+{
+    RoutingPolicy(bool costAware = false, double holdBack = 0.0, double smoothing = 0.2) :
+        costAware(costAware), holdBack(holdBack), smoothing(smoothing)
+    {}
+
+    bool costAware;  // Give each job to the idle worker with the lowest mean service time (otherwise to the first released)
+    double holdBack;  // Wait for a busy worker expected to finish the job holdBack times sooner than the fastest idle one (0 to never wait)
+    double smoothing;  // Weight of the last service time in the mean (EWMA)
+};
+
+
+/** When the QueueScheduler re-executes a straggler job (see set_hedging)
+  */
+struct HedgingPolicy
+{
+    HedgingPolicy(double percentile = 0.95, size_t minSamples = 20, size_t window = 256) :
+        percentile(percentile), minSamples(minSamples), window(window), interval(std::chrono::microseconds(1000))
+    {}
+
+    double percentile;  // A job is a straggler once it ran longer than this percentile of the recent service times
+    size_t minSamples;  // Service times observed before the first re-execution
+    size_t window;  // Number of recent service times kept
+    std::chrono::microseconds interval;  // Between two checks of the running jobs
+};
+
+
+// Maximum number of jobs pulled at once by an idle worker in WORK_STEALING mode
+constexpr size_t WORK_STEALING_REFILL = 8;
+
+// Reorder window given by launch_from to an upstream stage which has none
+constexpr size_t DEFAULT_CHAIN_WINDOW = 64;
+
+
 /** QueueScheduler allows to parallelize the work among threads while keeping the
   * output sequencial with respect to the input.
   * The pop call will be blocking while the release token hasn't been pushed.
+  * Each input receive a sequence number when read from the input queue. The
+  * workers write their output in the slot of that sequence number and the pop
+  * call release the slots in order.
+  * Several feeders can be launched at the same time. Each one has its own
+  * stream (input queue, output order and reorder window) while the workers
+  * are shared between all the streams. The streams get the workers in turn
+  * (first come, first served), so a busy stream cannot starve the others.
+  * In POOL mode, the worker threads are created by add_workers and live until
+  * the QueueScheduler is destructed (or the worker is retired, see
+  * set_autoscaling), which avoid the cost of a thread creation per job.
+  * In WORK_STEALING mode, the inputs are not dispatched by the scheduler
+  * thread anymore (which serialize all the handoffs). A worker which runs out
+  * of work steals the oldest job of another worker, or, if there is none,
+  * pulls up to WORK_STEALING_REFILL inputs from the input queue of the next
+  * stream (round robin), stamps them with their sequence number and keeps
+  * them in its local queue, where the other workers can steal them.
+  * The InputQueue parameter select the queue implementation used to transmit
+  * the inputs (QueueThread, QueueRingSPSC or QueueRingMPMC). Only a single
+  * thread push and pop on those queues. The scheduler only uses push_back,
+  * push_batch, pop_front, pop_for and set_wait_policy on them (the queue of
+  * the idle workers, which needs pop_select, is always a QueueThread).
+  * WARNING: A QueueRing is always bounded: with a maxInputSize UNLIMITED, the
+  * input queue holds at most DEFAULT_RING_SIZE inputs and the feeder blocks
+  * beyond.
+  * The Worker can be any class with a std::unique_ptr<Output> operator()(const Input&)
+  * (see WorkerTraits) and the feeder any callable returning a
+  * std::unique_ptr<Input>. Both are called without type erasure.
   */
-template <class Worker>
-// typename std::enable_if<std::is_base_of<WorkerBase<,>, Worker>::value, void>::type // TODO: How to constraint the class ?
+template <class Worker, template <typename> class InputQueue = QueueThread>
 class QueueScheduler
 {
 
-using Input = typename Worker::input_type;
-using Output = typename Worker::output_type;
+using Traits = WorkerTraits<Worker>;
+using Input = typename Traits::input_type;
+using Output = typename Traits::output_type;
+
+static_assert(Traits::is_callable, "The Worker has to define std::unique_ptr<Output> operator()(const Input&)");
 
 using InputPtr = std::unique_ptr<Input>;
 using OutputPtr = std::unique_ptr<Output>;
 using WorkerPtr = std::unique_ptr<Worker>;
-using Feeder = std::function<InputPtr()>;
+using KeyFunction = std::function<size_t(const Input&)>;
+using Deadline = std::chrono::steady_clock::time_point;
+using DeadlineFunction = std::function<Deadline(const Input&)>;
+
+struct Stream;  // Defined below
 
 public:
-    QueueScheduler(size_t maxInputSize = 1, size_t maxOutputSize = UNLIMITED);
+    /** Output side of a launched feeder. Can be copied and kept after the
+      * end of the stream
+      */
+    class StreamHandle
+    {
+    public:
+        StreamHandle() = default;  // Not attached to any stream
+
+        /** Same as QueueScheduler::pop, try_pop, pop_for and pop_batch but
+          * for the outputs of this stream only
+          */
+        OutputPtr pop();
+        OutputPtr pop(JobStatus& status);
+        bool try_pop(OutputPtr& output);
+        template <class Rep, class Period>
+        bool pop_for(OutputPtr& output, const std::chrono::duration<Rep, Period>& timeout);
+        size_t pop_batch(std::vector<OutputPtr>& outputs, size_t maxOutputs);
+
+        /** Same as QueueScheduler::set_reorder_window but for this stream only
+          */
+        void set_reorder_window(size_t window);
+        size_t reorder_window() const;
+
+        size_t id() const;
+
+    private:
+        friend class QueueScheduler;
+        StreamHandle(QueueScheduler* scheduler, const std::shared_ptr<Stream>& stream);
+
+        QueueScheduler* _scheduler = nullptr;
+        std::shared_ptr<Stream> _stream;
+    };
+
+    QueueScheduler(
+        size_t maxInputSize = 1,
+        size_t maxOutputSize = UNLIMITED,
+        DispatchMode mode = DispatchMode::ASYNC
+    );
     QueueScheduler(const QueueScheduler&) = delete;
     QueueScheduler& operator=(const QueueScheduler&) = delete;
-    ~QueueScheduler() = default;
+    ~QueueScheduler();
 
-    /** Construct some workers using the given factory
-      * TODO: What to do with the worker ids ? Reset each time ?
-      * or increment continuously ?
+    /** Construct some workers using the given factory. The worker ids keep
+      * incrementing across the calls (and the workers added by the
+      * autoscaling) from set_first_worker_id, so an id is never given twice.
+      * The factory is kept to build the workers added by the autoscaling.
+      * Can be called while the scheduler is running
       */
     void add_workers(
         const WorkerFactory<Worker>& factory = {},
         int nbWorker = 1
     );
 
-    /** Start launching the workers, with the given feeder
-      * Warning: if two feeders are launched at the same time,
-      * the behavior is undefined.
+    /** Id of the next worker constructed (0 by default). Give distinct ranges
+      * to several schedulers (ex: the stages of a pipeline) to have globally
+      * unique worker ids.
+      * WARNING: Not thread safe. Should be called before add_workers
+      */
+    void set_first_worker_id(int firstId);
+
+    /** Add and retire workers depending on the load (see ScalingPolicy), so
+      * a bursty stream doesn't need to be provisioned for its peak. The new
+      * workers are built with the factory of the last add_workers call. A
+      * worker is only retired while idle (between two jobs): its thread is
+      * stopped and the worker and its context (job queue, local queue) are
+      * deleted (its stats are kept). The workers
+      * already added count in the limits (add at least minWorkers of them).
+      * WARNING: Not thread safe. Should be called once, after add_workers
+      */
+    void set_autoscaling(const ScalingPolicy& policy);
+
+    /** Number of workers not retired. Can be read from any thread
+      */
+    size_t nb_workers() const;
+
+    /** Number of worker contexts allocated: the workers not retired, and the
+      * ones which retired themselves (WORK_STEALING mode) until the next
+      * autoscaling sample
+      */
+    size_t nb_worker_contexts();
+
+    /** Start launching the workers, with the given feeder, on a new stream.
+      * The feeder is any callable returning a std::unique_ptr<Input> (nullptr
+      * or ExpiredException when expired), or a batch feeder
+      * FeedStatus(std::vector<std::unique_ptr<Input>>& inputs, size_t maxInputs)
+      * which appends at most maxInputs inputs per call and reports the end of
+      * the stream without exception (see FeedStatus). The inputs of a batch are
+      * pushed in the input queue at once. It is moved to the feeder thread.
+      * A chunk feeder FeedStatus(size_t chunk, std::vector<std::unique_ptr<Input>>& inputs)
+      * appends the inputs of the given chunk of the source (numbered from 0)
+      * and is called concurrently by set_feeder_threads threads. Each chunk is
+      * requested once. The chunks are pushed in the order of their number, so
+      * the outputs keep the order of the source. The chunk returning END (or
+      * ERROR) is the last one: the chunks produced after it are dropped.
+      * If the feeder throws (or returns FeedStatus::ERROR), pop() rethrows the
+      * error once the outputs of the previous inputs have been popped.
+      * Can be called from any thread, while other feeders are running. The
+      * outputs are popped from the returned handle (or with pop() for the
+      * stream of the last launch)
+      */
+    template <class FeederFn>
+    StreamHandle launch(FeederFn feeder);
+
+    /** Chain this stage after another one: launch a new stream fed by the
+      * outputs of the upstream stage (a QueueScheduler whose Output is the
+      * Input of this one, or one of its StreamHandle), in their order. The
+      * outputs are moved to this stage without copy, by the feeder thread of
+      * the stream (see UpstreamFeeder), so no thread has to pop and re-feed
+      * between the stages. Each stage keeps its own workers and queues. The
+      * backpressure propagates upstream through the reorder window of the
+      * upstream stage: a full input queue here blocks the upstream outputs,
+      * which stops the upstream dispatch. If the upstream window is
+      * UNLIMITED, it is set to DEFAULT_CHAIN_WINDOW (otherwise a fast upstream
+      * stage would keep its outputs without bound).
+      * The errors of the upstream stage thrown after the first one (which
+      * ends this stream) are counted by nb_upstream_errors.
+      *
+      *   detect.launch_from(decode);
+      *   encode.launch_from(detect);
+      *   while(std::unique_ptr<Packet> out = encode.pop()) { ... }
+      *
+      * WARNING: The upstream stage has to outlive this stream, and its
+      * outputs shouldn't be popped by anyone else
+      */
+    template <class Source>
+    StreamHandle launch_from(Source& upstream);
+
+    /** Maximum distance between the oldest unpopped output and the next input
+      * dispatched. When reached, the scheduler stop dispatching until the
+      * head output is popped, which bound the number of outputs waiting in
+      * memory whatever the time taken by a slow job. The maxOutputSize
+      * given to the constructor is the initial window (UNLIMITED by default).
+      * Can be called at any time. Apply to each stream.
+      */
+    void set_reorder_window(size_t window);
+    size_t reorder_window();
+
+    /** Dispatch the inputs by batch of at most maxBatch inputs (the worker
+      * process_batch method is called instead of operator()). The scheduler
+      * collect the inputs until maxBatch are available or maxWait has elapsed
+      * since the first one, whichever comes first. A batch is never larger
+      * than the reorder window. The output order is unchanged.
+      * With maxBatch == 1 (default), each input is dispatched independently.
+      * WARNING: Not thread safe. Should be called before launch
+      */
+    void set_batching(size_t maxBatch, std::chrono::microseconds maxWait);
+
+    /** Number of threads calling a chunk feeder (see launch), independently
+      * of the number of workers. 1 by default. The other feeders always run on
+      * a single thread.
+      * WARNING: Not thread safe. Should be called before launch
+      */
+    void set_feeder_threads(size_t nbThreads);
+
+    /** Order in which the outputs are popped. With KEYED, the key of each
+      * input is given by keyFunction (ex: the camera or the object id set by
+      * the feeder) and an output is popped as soon as the previous outputs of
+      * the same key have been popped, so a slow job only delays its own key.
+      * With UNORDERED, the outputs are popped as soon as they are completed.
+      * The release token is always popped last. GLOBAL by default.
+      * WARNING: Not thread safe. Should be called before launch
+      */
+    void set_ordering(OrderingMode mode, const KeyFunction& keyFunction = {});
+
+    /** Drop the jobs which could not start before their deadline, so a
+      * lagging real-time stream catches up instead of falling further behind.
+      * The deadline of an input is its enqueue time + ttl (set_ttl) and/or the
+      * one given by deadlineFunction (ex: from the capture time set by the
+      * feeder), the earliest one applying. An expired input is skipped by the
+      * scheduler instead of waiting for a worker (or by the worker if it
+      * expired in its queue) and its output slot is marked dropped, so the
+      * next outputs don't wait for it. A batch is only dropped once all its
+      * inputs expired, and a started job is never interrupted.
+      * The dropped outputs are skipped by pop, try_pop, pop_for and pop_batch
+      * and returned by pop(JobStatus&). A zero ttl disables it (default).
+      * WARNING: Not thread safe. Should be called before launch
+      */
+    void set_ttl(std::chrono::steady_clock::duration ttl);
+    void set_deadline(const DeadlineFunction& deadlineFunction);
+
+    /** Choose the idle worker of each job from its speed, when the workers
+      * are heterogeneous (ex: fast and slow devices). By default, the job goes
+      * to the first released worker, so the oldest job (the one which blocks
+      * the next outputs) can land on the slowest worker.
+      * With policy.costAware, the mean service time of each worker is tracked
+      * (EWMA) and the jobs, dispatched in order, go to the fastest idle worker
+      * (a new worker is tried first). With policy.holdBack > 0, a job waits
+      * for a busy worker if it is expected to finish it (remaining time of its
+      * current job included) holdBack times sooner than the fastest idle one,
+      * and at most as long as waiting pays off.
+      * Only used in ASYNC and POOL mode (in WORK_STEALING mode, the idle
+      * workers pull their jobs).
+      * WARNING: Not thread safe. Should be called before launch
+      */
+    void set_routing(const RoutingPolicy& policy);
+
+    /** Re-execute the stragglers (ex: a worker hitting a slow path or a
+      * throttled device) instead of letting them stall the ordered output
+      * while other workers are idle. Once the oldest running job of a stream
+      * ran longer than policy.percentile of the recent service times, its
+      * inputs are dispatched again to an idle worker (or the next released
+      * one, before the jobs of the streams). The first
+      * attempt to finish fills the output slots and the other one is discarded
+      * (an error only wins if no other attempt is still running). A job is
+      * re-executed at most once.
+      * The inputs are shared by the attempts, so the workers have to support
+      * reading the same input concurrently, and the jobs to be run twice.
+      * Only used in ASYNC and POOL mode (throw std::logic_error otherwise).
+      * WARNING: Not thread safe. Should be called once, before launch
+      */
+    void set_hedging(const HedgingPolicy& policy);
+
+    /** Pin the threads to some cores (see PlacementPolicy), instead of letting
+      * the OS move them across all the cores (cold caches, and remote memory
+      * accesses on a NUMA machine). In POOL and WORK_STEALING mode, the worker
+      * threads are pinned once, in ASYNC mode each job thread is pinned. The
+      * workers are constructed on a thread pinned to their cores, so the
+      * buffers allocated by their constructor are placed on the NUMA node of
+      * these cores (first touch policy of the OS), as well as the outputs they
+      * allocate. A core which cannot be used (outside Linux, not allowed)
+      * leaves the thread unpinned.
+      * WARNING: Not thread safe. Should be called first (before add_workers,
+      * set_autoscaling, set_hedging and launch)
+      */
+    void set_placement(const PlacementPolicy& policy);
+
+    /** How the threads wait on the given handoff (see WaitPolicy). Each
+      * handoff blocks on a condition variable by default, and the sleep and
+      * wake up of the waiting thread adds tens of microseconds to the
+      * latency. SPIN_THEN_BLOCK saves it on the short waits, BUSY_POLL on all
+      * of them at the cost of a core per waiting thread. The policy applies
+      * to the existing and future streams (INPUTS, OUTPUTS) and workers (JOBS).
+      * WARNING: Not thread safe. Should be called before launch
+      */
+    void set_wait_policy(Handoff handoff, const WaitPolicy& policy);
+
+    /** Pools of recycled input and output buffers. The feeder should acquire
+      * its inputs from input_pool() and the workers their outputs from
+      * output_pool() (ex: by giving &output_pool() to the WorkerFactory).
+      * Once processed, the inputs are given back to the input pool if
+      * set_recycling(true) has been called (otherwise they are deleted).
+      * The popped outputs are given back to the output pool by recycle.
+      * In steady state (and with a QueueRing input queue and the POOL mode),
+      * no allocation is done per job, which can be checked with the pools
+      * nb_allocations.
+      */
+    ObjectPool<Input>& input_pool();
+    ObjectPool<Output>& output_pool();
+
+    /** WARNING: Not thread safe. Should be called before launch
       */
-    void launch(const Feeder& feeder);
+    void set_recycling(bool recycleInputs);
 
     // Queues modifiers
 
     /** Block while the list is empty.
       * Return the First-In has soon as it has been released
+      * Pop the stream of the last launch call.
       */
     OutputPtr pop();
 
+    /** Same as pop but also return the dropped jobs (see set_ttl): status is
+      * DROPPED (and the output nullptr) for each of them, RELEASED for the
+      * release token and DONE otherwise
+      */
+    OutputPtr pop(JobStatus& status);
+
+    /** Same as pop but never wait. Return false if the next output is not
+      * ready yet (output is unchanged)
+      */
+    bool try_pop(OutputPtr& output);
+
+    /** Same as pop but wait at most for the given duration. Return false if
+      * the next output is still not ready (output is unchanged)
+      */
+    template <class Rep, class Period>
+    bool pop_for(OutputPtr& output, const std::chrono::duration<Rep, Period>& timeout);
+
+    /** Block while the next output is not ready, then append all the outputs
+      * already releasable (at most maxOutputs) to outputs, with a single lock
+      * and wakeup. The release token (nullptr) is always the last output
+      * appended. An error is rethrown once the outputs before it have been
+      * popped. Return the number of outputs appended
+      */
+    size_t pop_batch(std::vector<OutputPtr>& outputs, size_t maxOutputs);
+
     /** Final token. Make the pop call non blocking
       */
     void push_release();
 
+    /** Give back a popped output to the output pool
+      */
+    void recycle(OutputPtr output);
+
     // Utils
 
     /** Convinience method for communication between main thread and the
@@ -74,28 +485,423 @@ public:
       */
     const std::list<WorkerPtr>& get_workers();
 
+    /** Maximum number of outputs which had to wait for a previous slot
+      * (completed but not releasable yet), for the stream of the last launch
+      */
+    size_t peak_out_of_order();
+
+    /** Number of times the dispatch has been delayed because the reorder window
+      * was full, and the total time the scheduler waited for it (stream of the
+      * last launch)
+      */
+    size_t window_stalls();
+    std::chrono::nanoseconds window_stalls_duration();
+
+    /** Number of jobs dropped because of their deadline (all the streams).
+      * Each stage of a pipeline reports its own drops
+      */
+    size_t nb_dropped() const;
+
+    /** Number of errors of the upstream stages discarded because an earlier
+      * one already ended the stream (see launch_from)
+      */
+    size_t nb_upstream_errors() const;
+
+    /** Number of jobs which waited for a faster busy worker (see set_routing)
+      */
+    size_t nb_held_back() const;
+
+    // Can be read from any thread (see set_hedging)
+    size_t nb_hedged() const;  // Jobs re-executed
+    size_t nb_hedges_won() const;  // Re-executions which finished first
+
+    /** Runtime metrics (queue depths, waiting times, worker service times,...)
+      * Can be read from any thread while the scheduler is running. Only
+      * recorded if JS_ENABLE_STATS is defined (otherwise the scheduler does not
+      * hold any statistics and an empty SchedulerStats is returned).
+      */
+    const SchedulerStats& stats() const;
+
+    /** Record the timeline of each job (produced by the feeder, dispatched,
+      * run by a worker and popped) on one lane per thread, to find which job
+      * blocked the others. nbReservedEvents are preallocated per lane.
+      * WARNING: Not thread safe. Should be called before launch
+      */
+    void enable_tracing(size_t nbReservedEvents = 0);
+
+    /** Export the timeline in the Chrome trace-event format (open it with
+      * chrome://tracing or https://ui.perfetto.dev).
+      * WARNING: Should be called once the last output has been popped
+      */
+    void write_trace(std::ostream& os) const;
+
 private:
+    /** Element of the input queue
+      */
+    struct InputEntry
+    {
+        InputPtr input;
+        Deadline deadline;  // Deadline::max() if none
+        std::chrono::steady_clock::time_point enqueued;  // Only set if JS_ENABLE_STATS is defined (same layout either way)
+    };
+
+    /** Inputs and outputs of a launched feeder
+      */
+    struct Stream
+    {
+        Stream(size_t streamId, size_t maxInputSize, size_t maxOutputSize) :
+            id(streamId), inputs(maxInputSize), outputs(maxOutputSize), nbQueuedInputs(0),
+            launched(false), exhausted(false), refilling(false), released(false),
+            feederLane(nullptr), schedulerLane(nullptr), consumerLane(nullptr), poppedSequences()
+        {}
+
+        const size_t id;
+        InputQueue<InputEntry> inputs;
+        ReorderBuffer<OutputPtr> outputs;
+        std::atomic<size_t> nbQueuedInputs;  // Pushed (or being pushed) and not popped yet, including the final token
+        std::future<void> feeder;  // Feeder thread of the stream
+        std::exception_ptr feederError;  // Set by the feeder thread before pushing the final token
+        std::future<void> scheduler;  // Scheduler thread of the stream
+
+        // Protected by _mutexStreams
+        bool launched;
+        bool exhausted;  // The feeder expired and all the inputs have been pulled (WORK_STEALING mode)
+        bool refilling;  // A worker is pulling the inputs (WORK_STEALING mode)
+
+        std::atomic<bool> released;  // The release token has been popped
+
+        // Only used if tracing
+        TraceLane* feederLane;
+        TraceLane* schedulerLane;
+        TraceLane* consumerLane;
+        std::vector<size_t> poppedSequences;  // Of the last pop_batch (only used by the consumer)
+    };
+
+    struct Attempts;
+
+    /** Job sent to a worker. Either a single input or a batch of inputs (with
+      * the consecutive sequences). A job without input stop the pool thread
+      */
+    struct Job
+    {
+        Stream* stream;
+        size_t sequence;
+        InputPtr input;
+        std::vector<InputPtr> batch;
+        Deadline deadline;  // Latest deadline of the inputs
+        std::shared_ptr<Attempts> attempts;  // Only set for a re-execution (without inputs)
+    };
+
+    /** Attempts of a job when hedging: the original run and its re-execution.
+      * Own the inputs, read concurrently by the attempts
+      */
+    struct Attempts
+    {
+        Attempts(Job&& job, size_t streamId, size_t nbInputs) :
+            job(std::move(job)), streamId(streamId), nbInputs(nbInputs), start(std::chrono::steady_clock::now()),
+            nbRunning(1), finished(false), hedged(false)
+        {}
+
+        Job job;
+        const size_t streamId;  // The stream can be over before the last attempt
+        const size_t nbInputs;
+        const std::chrono::steady_clock::time_point start;  // Of the original run
+        std::atomic<size_t> nbRunning;  // The last one releases the inputs
+        std::atomic<bool> finished;  // Claimed by the attempt which fills the output slots
+        bool hedged;  // Protected by _mutexHedging
+    };
+
+    /** Everything needed to run the jobs of a given worker
+      */
+    struct WorkerContext
+    {
+        Worker* worker;
+        size_t index;
+        JS_STATS(WorkerStats* stats;)
+        TraceLane* lane;  // nullptr if not tracing
+        std::mutex mutexTask;  // Only used in ASYNC mode (the worker can be acquired by another stream before task is assigned)
+        std::future<void> task;  // Only used in ASYNC mode
+        InputQueue<Job> jobs;  // Only used in POOL mode
+        std::thread thread;  // Only used in POOL and WORK_STEALING mode
+        CpuSet cpus;  // Empty if not pinned
+
+        // Only used in WORK_STEALING mode
+        std::mutex mutexLocal;
+        std::deque<Job> localJobs;  // Sorted by sequence
+
+        // Only used if cost aware routing
+        std::atomic<int64_t> cost{0};  // Mean service time of an input (EWMA, in ns), 0 until the first job
+        std::atomic<int64_t> busySince{0};  // Acquisition time (steady clock, in ns), 0 while idle
+    };
+
     /** Launch the workers and feed them
-      * Run asynchronusly
+      * Run asynchronusly (one thread per stream)
       */
-    void scheduler_job(const Feeder& feeder);
+    void scheduler_job(Stream* stream);
+    void dispatch_job(WorkerContext* context, Job job);  // Send the job to the acquired worker
 
     /** Feeder thread which tries to permanatly feed the queue
       * Wait when the queue is full
       */
-    void feeder_job(const Feeder& feeder);
+    template <class FeederFn>
+    void feeder_job(Stream* stream, FeederFn feeder);
+
+    // Feeder loop of each protocol. Return when the feeder expire
+    template <FeederProtocol protocol>
+    using ProtocolTag = std::integral_constant<FeederProtocol, protocol>;
+    template <class FeederFn>
+    void feed(Stream* stream, FeederFn& feeder, ProtocolTag<FeederProtocol::ITEM>);
+    template <class FeederFn>
+    void feed(Stream* stream, FeederFn& feeder, ProtocolTag<FeederProtocol::BATCH>);
+    template <class FeederFn>
+    void feed(Stream* stream, FeederFn& feeder, ProtocolTag<FeederProtocol::CHUNK>);
+
+    /** Chunks produced concurrently by the feeder threads (chunk protocol).
+      * Each thread waits for its turn to push its chunk
+      */
+    struct ChunkMerge
+    {
+        std::atomic<size_t> nextChunk{0};  // Next chunk to produce
+        std::mutex mutexTurn;
+        std::condition_variable cvTurn;
+        size_t nextPush = 0;  // Next chunk to push
+        size_t endChunk = std::numeric_limits<size_t>::max();  // Last chunk of the source (once known)
+        size_t sequence = 0;  // Sequence of the next input pushed
+        std::exception_ptr error;
+    };
+
+    /** Loop of a feeder thread (chunk protocol)
+      */
+    template <class FeederFn>
+    void feed_chunks(Stream* stream, FeederFn& feeder, ChunkMerge& merge, TraceLane* lane);
+
+    /** Push the non null inputs in the input queue at once (inputs is
+      * cleared), record them on the lane (if tracing) and return the number of
+      * inputs pushed. sequence is the position of the first one in the stream
+      */
+    size_t push_inputs(
+        Stream* stream,
+        TraceLane* lane,
+        std::vector<InputPtr>& inputs,
+        std::vector<InputEntry>& entries,  // Reused buffer
+        size_t sequence,
+        TraceLane::Clock::time_point produceStart,
+        TraceLane::Clock::time_point produceEnd
+    );
+
+    /** Collect the next inputs until the batch is full or the batching timeout
+      * expire. Return false if the feeder expired
+      */
+    bool collect_batch(Job& job, size_t maxBatch);
+
+    /** Complete the job from its first input (collect the batch if any) and
+      * reserve its output slots. Return false if the feeder expired
+      */
+    bool prepare_job(Job& job);
+    size_t key_of(const Input& input) const;  // Key of the output slot
+
+    /** Pop the next entry from the input queue (without input when the
+      * feeder expired). If timeout is given, return false if no input has been
+      * received in time
+      */
+    InputEntry pop_input(Stream* stream);
+    bool pop_input_for(Stream* stream, InputEntry& entry, std::chrono::steady_clock::duration timeout);
+
+    /** Start a new job of the stream with the next input which has not
+      * expired (without input when the feeder expired). The expired ones are
+      * dropped before. If wait is false, never wait for the input queue.
+      * Return false if no job has been started (all the queued inputs have
+      * been dropped)
+      */
+    bool start_job(Stream* stream, Job& job, bool wait);
+
+    // Deadlines helpers (see set_ttl)
+    Deadline ttl_deadline() const;  // Deadline of the inputs enqueued now
+    Deadline deadline_of(const Input& input, Deadline ttlDeadline) const;
+    static bool is_expired(Deadline deadline);
+    void drop_input(Stream* stream, InputPtr input);  // Reserve and drop the output slot of the input
+
+    /** Wait for an available worker. The streams are served in the order of
+      * their request
+      */
+    WorkerContext* acquire_worker(size_t nbInputs);
+
+    // Cost aware routing helpers (see set_routing)
+    WorkerContext* acquire_fastest(size_t nbInputs);
+    int64_t expected_busy_cost(const WorkerContext* idle, size_t nbInputs, int64_t now);  // Soonest end of the job on a busy worker, 0 if none is known
+    void update_cost(WorkerContext* context, std::chrono::steady_clock::time_point start, size_t nbInputs);
+    static int64_t now_ns();
+
+    /** Hedging thread. Re-execute the oldest running job of each stream once
+      * it is a straggler, while there are idle workers (see set_hedging)
+      */
+    void hedger_job();
+    std::shared_ptr<Attempts> find_straggler();  // Lock _mutexHedging has to be acquired
+    WorkerContext* wait_released_worker();  // Take the next released worker, nullptr if none in time
+    void hedge(const std::shared_ptr<Attempts>& attempts, WorkerContext* context);  // Lock _mutexHedging has to be acquired
+    std::shared_ptr<Attempts> start_attempts(Job job, size_t streamId, size_t nbInputs);  // Take the inputs and register the running job
+
+    /** End an attempt of the job and return true if it has to fill the output
+      * slots. The last attempt releases the inputs
+      */
+    bool end_attempt(const std::shared_ptr<Attempts>& attempts, std::chrono::steady_clock::time_point start, bool success, bool speculative);
+
+    /** Worker thread which process a single job and fill the output slots
+      * previously reserved
+      */
+    void worker_job(WorkerContext* context, Job job);
+
+    /** Give back the processed inputs to the input pool (if recycling)
+      */
+    void release_inputs(Job& job);
+
+    /** Record the run of a job and its completion on the worker lane (if
+      * tracing)
+      */
+    void trace_run(WorkerContext* context, TraceLane::Clock::time_point runStart, size_t streamId, size_t sequence, size_t nbInputs, bool completed);  // "discarded" if not completed
 
-    /** Worker thread which process a single input and update the future result
-      * previously pushed on the queue
+    /** Long-lived thread of a worker (POOL mode). Process the jobs sent by the
+      * scheduler until the stop token is received
       */
-    OutputPtr worker_job(WorkerPtr worker, InputPtr input);
+    void pool_job(WorkerContext* context);
+
+    /** Long-lived thread of a worker (WORK_STEALING mode). Process the jobs of
+      * its local queue, then the stolen ones, then the pulled ones, until the
+      * QueueScheduler is destructed
+      */
+    void stealing_job(WorkerContext* context);
+
+    /** Build a worker with the stored factory and start it. Lock _mutexWorkers
+      * has to be acquired
+      */
+    void add_worker();
+
+    /** Autoscaling thread. Sample the load every interval and add or retire
+      * the workers (see ScalingPolicy)
+      */
+    void scaler_job();
+    size_t nb_waiting_inputs();  // Inputs not dispatched yet (all the streams)
+    size_t nb_idle_workers();
+    bool retire_idle_worker();  // Return false if no worker is idle
+    void remove_worker(WorkerContext* context);  // Delete the worker (and its context if its thread is stopped)
+    void publish_contexts();  // Update the contexts of the workers not retired. Lock _mutexWorkers has to be acquired
+    void erase_retired_contexts();  // Join the workers which retired themselves (WORK_STEALING mode) and delete their context
+
+    // WORK_STEALING helpers. Return false if no job has been found
+    bool pop_local(WorkerContext* context, Job& job);
+    bool steal(WorkerContext* context, Job& job);
+    bool refill(WorkerContext* context, Job& job);
+    Stream* next_refill_stream();  // Lock _mutexStreams has to be acquired. nullptr if no input is waiting
+    void notify_idle();  // Wake up an idle worker (new input)
+
+    /** Give back the worker once its job is done (except in WORK_STEALING
+      * mode where the workers are not dispatched)
+      */
+    void release_worker(WorkerContext* context);
+
+    // Streams helpers
+    OutputPtr pop_stream(Stream& stream);
+    OutputPtr pop_stream(Stream& stream, JobStatus& status);
+    template <class Rep, class Period>
+    bool pop_stream_for(Stream& stream, OutputPtr& output, const std::chrono::duration<Rep, Period>& timeout);
+    size_t pop_stream_batch(Stream& stream, std::vector<OutputPtr>& outputs, size_t maxOutputs);
+    void on_popped(Stream& stream, const OutputPtr& output, size_t sequence, TraceLane::Clock::time_point traceStart);  // Release and tracing
+    void release_stream(Stream& stream);  // Push the release token
+    std::shared_ptr<Stream> default_stream();
+    void trace_stream(Stream& stream);  // Create the lanes of the stream (if tracing)
+
+    // Apply the wait policies set for the inputs and outputs of a stream, or the jobs of a worker
+    void apply_wait_policies(Stream& stream);
+    void apply_wait_policies(WorkerContext& context);
+
+    const DispatchMode _mode;
+
+    size_t _maxBatch;
+    std::chrono::microseconds _batchTimeout;
+
+    OrderingMode _ordering;
+    KeyFunction _keyFunction;
+
+    size_t _nbFeederThreads;
+
+    std::chrono::steady_clock::duration _ttl;
+    DeadlineFunction _deadlineFunction;
+    std::atomic<size_t> _nbDropped;
+
+    std::atomic<size_t> _nbUpstreamErrors;
+
+    RoutingPolicy _routing;
+    std::atomic<size_t> _nbHeldBack;
+
+    // Only used if hedging
+    HedgingPolicy _hedging;
+    bool _hedgingEnabled;
+    std::thread _hedger;
+    std::mutex _mutexHedging;  // Protect the running jobs and the service times
+    std::condition_variable _cvHedging;
+    bool _stopHedger;
+    std::list<std::shared_ptr<Attempts>> _runningJobs;  // In dispatch order
+    std::vector<int64_t> _serviceSamples;  // Recent service times of an input (in ns, ring buffer)
+    size_t _nextSample;
+    std::atomic<bool> _hedgeRequested;  // The next released worker goes to the hedger
+    QueueThread<WorkerContext*> _hedgeHandoff;
+    std::atomic<size_t> _nbHedged;
+    std::atomic<size_t> _nbHedgesWon;
+
+    PlacementPolicy _placement;
+
+    std::vector<std::pair<Handoff, WaitPolicy>> _waitPolicies;  // In call order (the last one of a handoff applies)
+
+    bool _recycleInputs;
+    ObjectPool<Input> _inputPool;
+    ObjectPool<Output> _outputPool;
+
+    std::mutex _mutexWorkers;  // Protect the workers and contexts lists, the factory and the ids
+    std::list<WorkerPtr> _workers;  // Own the workers
+    std::list<std::shared_ptr<WorkerContext>> _contexts;  // Removed once the worker is retired and its thread joined (but lives until the last snapshot referencing it is released)
+    std::unique_ptr<WorkerFactory<Worker>> _factory;  // Of the last add_workers call
+    int _nextWorkerId;
+    size_t _nextContextIndex;
+    std::atomic<size_t> _nbWorkers;  // Not retired
+    std::shared_ptr<const std::vector<std::shared_ptr<WorkerContext>>> _activeContexts;  // Replaced (atomic_store) when a worker is added or retired
+
+    // Only used if autoscaling
+    ScalingPolicy _scaling;
+    std::thread _scaler;
+    std::mutex _mutexScaler;
+    std::condition_variable _cvScaler;
+    bool _stopScaler;
 
     // Thread safe collections
-    QueueThread<WorkerPtr> _availableWorkers;
-    QueueThread<InputPtr> _inputQueue;
-    QueueThread<std::future<OutputPtr>> _outputQueue;
+    QueueThread<WorkerContext*> _availableWorkers;
 
-    std::future<void> _schedulerFutur;  // Is linked to the schedulerFutur (is necessary to avoid blocking async)
+    // Fair acquisition of the workers between the streams (ticket based)
+    std::mutex _mutexTurn;
+    std::condition_variable _cvTurn;
+    size_t _nextTicket;
+    size_t _servedTicket;
+
+    JS_STATS(SchedulerStats _stats;)  // Not even constructed otherwise
+
+    // Only used if tracing
+    std::unique_ptr<JobTracer> _tracer;
+
+    // Streams
+    const size_t _maxInputSize;
+    size_t _reorderWindow;
+    std::mutex _mutexStreams;  // Protect the streams list and their states (and the WORK_STEALING idle states)
+    std::vector<std::shared_ptr<Stream>> _streams;  // Running streams (and the last launched one)
+    std::shared_ptr<Stream> _defaultStream;  // Stream of the last launch
+    size_t _nbStreams;  // Used for the ids
+
+    // Only used in WORK_STEALING mode
+    std::atomic<size_t> _nbLocalJobs;  // Total number of jobs in the local queues
+    std::atomic<size_t> _nbIdleWorkers;
+    std::condition_variable _cvIdle;  // Wait for jobs to steal or inputs to pull
+    std::condition_variable _cvExhausted;  // Wait for the end of a stream (scheduler threads)
+    size_t _refillCursor;  // Next stream to pull from (round robin)
+    size_t _nbRetiring;  // Idle workers requested to retire
+    bool _stopping;
 };
 
 
@@ -106,136 +912,2260 @@ class ExpiredException : public std::exception
 };
 
 
-template <class Worker>
-QueueScheduler<Worker>::QueueScheduler(size_t maxInputSize, size_t maxOutputSize) :
-    _inputQueue(maxInputSize),
-    _outputQueue(maxOutputSize)
+template <class Worker, template <typename> class InputQueue>
+QueueScheduler<Worker, InputQueue>::StreamHandle::StreamHandle(QueueScheduler* scheduler, const std::shared_ptr<Stream>& stream) :
+    _scheduler(scheduler),
+    _stream(stream)
 {
 }
 
 
-template <class Worker>
-void QueueScheduler<Worker>::add_workers(
-    const WorkerFactory<Worker>& factory,
-    int nbWorker
-)
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::StreamHandle::pop() -> OutputPtr
 {
-    for (int i = 0 ; i < nbWorker ; ++i)
-    {
-        _availableWorkers.push_back(factory.buildNew(i));
-    }
+    return _scheduler->pop_stream(*_stream);
 }
 
 
-template <class Worker>
-void QueueScheduler<Worker>::launch(const Feeder& feeder)
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::StreamHandle::pop(JobStatus& status) -> OutputPtr
 {
-    // Will launch the scheduler
-    _schedulerFutur = std::async(  // To avoid blocking call, need to capture the future in a member variable (future has blocking destructor)
-        std::launch::async,
-        &QueueScheduler::scheduler_job, this, // Will call this->scheduler_job(feeder)
-        feeder  // Warning: the argument is copied inside std::async
-    );
+    return _scheduler->pop_stream(*_stream, status);
 }
 
 
-template <class Worker>
-void QueueScheduler<Worker>::scheduler_job(const Feeder& feeder)
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::StreamHandle::try_pop(OutputPtr& output)
 {
-    // Launch the feeder on another thread
-    std::future<void> feederFutur = std::async(  // Capture the future to avoid blocking call
-        std::launch::async,
-        &QueueScheduler::feeder_job, this,
-        feeder
-    );
-
-    while(InputPtr input = _inputQueue.pop_front())  // Get the next input (eventually exit when the feeder expire) (TODO: Could also add a timeout or other exit conditions)
-    {
-        // In case of exit, even if there has been some threads which did not
-        // finished yet, all previous futures have already been pushed to the
-        // Queue, so the main program will grab all the frames
+    return _scheduler->pop_stream_for(*_stream, output, std::chrono::nanoseconds::zero());
+}
 
-        // Launch the task (encapsulate the worker)
-        std::future<OutputPtr> returnedValue = std::async(
-            std::launch::async,
-            &QueueScheduler::worker_job, this,
-            _availableWorkers.pop_front(),  // Wait for an available worker
-            std::move(input)
-        );
 
-        // Push the returnedValue into the output queue
-        // the order is concerved (will be used to reference the output
-        // while keeping track of the  order)
-        _outputQueue.push_back(std::move(returnedValue));
-    }
-    push_release(); // Finally release output queue
+template <class Worker, template <typename> class InputQueue>
+template <class Rep, class Period>
+bool QueueScheduler<Worker, InputQueue>::StreamHandle::pop_for(OutputPtr& output, const std::chrono::duration<Rep, Period>& timeout)
+{
+    return _scheduler->pop_stream_for(*_stream, output, timeout);
 }
 
 
-template <class Worker>
-void QueueScheduler<Worker>::feeder_job(const Feeder& feeder)
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::StreamHandle::pop_batch(std::vector<OutputPtr>& outputs, size_t maxOutputs)
 {
-    try
-    {
-        while(InputPtr nextInput = feeder())
-        {
-            if (!nextInput)
-            {
-                throw ExpiredException{};
-            }
-            _inputQueue.push_back(std::move(nextInput));
-        }
-    }
-    catch (const ExpiredException& e)
-    {
-        // Release input queue
-        _inputQueue.push_back(nullptr); // unique_ptr automatically deduced
-    }
+    return _scheduler->pop_stream_batch(*_stream, outputs, maxOutputs);
 }
 
 
-template <class Worker>
-auto QueueScheduler<Worker>::worker_job(WorkerPtr worker, InputPtr input) -> OutputPtr
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::StreamHandle::set_reorder_window(size_t window)
 {
-    // Launch the task
-    OutputPtr output = (*worker)(*input.get());
+    _stream->outputs.set_max_size(window);
+}
 
-    // The worker finished its job, so can be used again
-    _availableWorkers.push_back(std::move(worker));
 
-    // Release the future
-    return output;
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::StreamHandle::reorder_window() const
+{
+    return _stream->outputs.max_size();
 }
 
 
-template <class Worker>
-void QueueScheduler<Worker>::push_release()
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::StreamHandle::id() const
 {
-    // TODO: Make sure this function is called only once ? <= In that case,
-    // be sure to reinitialize when calling launch again
-    std::promise<OutputPtr> promise;
-    std::future<OutputPtr> finalToken = promise.get_future();
-    promise.set_value(OutputPtr(nullptr));
-
-    _outputQueue.push_back(std::move(finalToken));
+    return _stream->id;
 }
 
 
-template <class Worker>
-auto QueueScheduler<Worker>::pop() -> OutputPtr
+template <class Worker, template <typename> class InputQueue>
+QueueScheduler<Worker, InputQueue>::QueueScheduler(
+    size_t maxInputSize,
+    size_t maxOutputSize,
+    DispatchMode mode
+) :
+    _mode(mode),
+    _maxBatch(1),
+    _batchTimeout(0),
+    _ordering(OrderingMode::GLOBAL),
+    _keyFunction(),
+    _nbFeederThreads(1),
+    _ttl(std::chrono::steady_clock::duration::zero()),
+    _deadlineFunction(),
+    _nbDropped(0),
+    _nbUpstreamErrors(0),
+    _routing(),
+    _nbHeldBack(0),
+    _hedging(),
+    _hedgingEnabled(false),
+    _hedger(),
+    _mutexHedging(),
+    _cvHedging(),
+    _stopHedger(false),
+    _runningJobs(),
+    _serviceSamples(),
+    _nextSample(0),
+    _hedgeRequested(false),
+    _hedgeHandoff(),
+    _nbHedged(0),
+    _nbHedgesWon(0),
+    _placement(),
+    _waitPolicies(),
+    _recycleInputs(false),
+    _inputPool(),
+    _outputPool(),
+    _mutexWorkers(),
+    _workers(),
+    _contexts(),
+    _factory(nullptr),
+    _nextWorkerId(0),
+    _nextContextIndex(0),
+    _nbWorkers(0),
+    _activeContexts(new std::vector<std::shared_ptr<WorkerContext>>()),
+    _scaling(),
+    _scaler(),
+    _mutexScaler(),
+    _cvScaler(),
+    _stopScaler(false),
+    _availableWorkers(),
+    _mutexTurn(),
+    _cvTurn(),
+    _nextTicket(0),
+    _servedTicket(0),
+    _tracer(nullptr),
+    _maxInputSize(maxInputSize),
+    _reorderWindow(maxOutputSize),
+    _mutexStreams(),
+    _streams(),
+    _defaultStream(nullptr),
+    _nbStreams(0),
+    _nbLocalJobs(0),
+    _nbIdleWorkers(0),
+    _cvIdle(),
+    _cvExhausted(),
+    _refillCursor(0),
+    _nbRetiring(0),
+    _stopping(false)
 {
-    std::future<OutputPtr> output = _outputQueue.pop_front();
-    return output.get();  // Will wait for the worker to finish
+    // Stream of the first launch (so pop can be called before launch)
+    _defaultStream = std::make_shared<Stream>(_nbStreams++, _maxInputSize, _reorderWindow);
+    JS_STATS(_defaultStream->outputs.set_wait_histogram(&_stats.outputWait);)
+    _streams.push_back(_defaultStream);
 }
 
 
-template <class Worker>
-auto QueueScheduler<Worker>::get_workers() -> const std::list<WorkerPtr>&
+template <class Worker, template <typename> class InputQueue>
+QueueScheduler<Worker, InputQueue>::~QueueScheduler()
 {
-    return _availableWorkers.get_data();
+    std::vector<std::shared_ptr<Stream>> streams;
+    {
+        std::lock_guard<std::mutex> guard(_mutexStreams);
+        streams = _streams;
+    }
+    for (std::shared_ptr<Stream>& stream : streams)
+    {
+        if (stream->scheduler.valid())
+        {
+            stream->scheduler.wait();  // All jobs have been dispatched after that
+        }
+        if (stream->feeder.valid())
+        {
+            stream->feeder.wait();
+        }
+    }
+
+    if (_scaler.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(_mutexScaler);
+            _stopScaler = true;
+        }
+        _cvScaler.notify_all();
+        _scaler.join();
+    }
+    if (_hedger.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(_mutexHedging);
+            _stopHedger = true;
+        }
+        _cvHedging.notify_all();
+        _hedger.join();
+    }
+
+    // The stop tokens are processed after the remaining jobs
+    if (_mode == DispatchMode::WORK_STEALING)
+    {
+        {
+            std::lock_guard<std::mutex> guard(_mutexStreams);
+            _stopping = true;
+        }
+        _cvIdle.notify_all();
+    }
+    for (std::shared_ptr<WorkerContext>& context : _contexts)
+    {
+        if (context->task.valid())
+        {
+            context->task.wait();
+        }
+        if (context->thread.joinable())
+        {
+            if (_mode == DispatchMode::POOL)
+            {
+                context->jobs.push_back(Job{});
+            }
+            context->thread.join();
+        }
+    }
 }
 
 
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::add_workers(
+    const WorkerFactory<Worker>& factory,
+    int nbWorker
+)
+{
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    _factory.reset(new WorkerFactory<Worker>(factory));
+    for (int i = 0 ; i < nbWorker ; ++i)
+    {
+        add_worker();
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_first_worker_id(int firstId)
+{
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    _nextWorkerId = firstId;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_autoscaling(const ScalingPolicy& policy)
+{
+    if (policy.minWorkers > policy.maxWorkers || policy.maxWorkers == 0)
+    {
+        throw std::invalid_argument("The autoscaling requires 0 < maxWorkers and minWorkers <= maxWorkers");
+    }
+    {
+        std::lock_guard<std::mutex> guard(_mutexWorkers);
+        if (!_factory)
+        {
+            throw std::logic_error("add_workers has to be called before set_autoscaling");
+        }
+    }
+    _scaling = policy;
+    if (!_scaler.joinable())
+    {
+        _scaler = std::thread(&QueueScheduler::scaler_job, this);
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_workers() const
+{
+    return _nbWorkers.load();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_worker_contexts()
+{
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    return _contexts.size();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::add_worker()
+{
+    int workerId = _nextWorkerId++;
+    CpuSet cpus = _placement.workerCpus ? _placement.workerCpus(workerId) : CpuSet();
+    if (cpus.empty())
+    {
+        _workers.push_back(_factory->buildNew(workerId));
+    }
+    else
+    {
+        // Constructed on its cores, so its buffers are allocated on their NUMA node
+        const WorkerFactory<Worker>& factory = *_factory;
+        _workers.push_back(std::async(std::launch::async, [&factory, &cpus, workerId]() {
+            pin_current_thread(cpus);
+            return factory.buildNew(workerId);
+        }).get());
+    }
+
+    _contexts.push_back(std::make_shared<WorkerContext>());
+    WorkerContext* context = _contexts.back().get();
+    context->worker = _workers.back().get();
+    context->cpus = std::move(cpus);
+    apply_wait_policies(*context);
+    context->index = _nextContextIndex++;
+    JS_STATS(context->stats = &_stats.add_worker();)
+    context->lane = _tracer ? &_tracer->add_lane("worker " + std::to_string(context->index)) : nullptr;
+    ++_nbWorkers;
+    publish_contexts();
+    if (_mode == DispatchMode::POOL)
+    {
+        context->thread = std::thread(&QueueScheduler::pool_job, this, context);
+    }
+    else if (_mode == DispatchMode::WORK_STEALING)
+    {
+        context->thread = std::thread(&QueueScheduler::stealing_job, this, context);
+        return;  // Never dispatched by the scheduler
+    }
+
+    _availableWorkers.push_back(context);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::scaler_job()
+{
+    pin_current_thread(_placement.schedulerCpus);  // No-op if not pinned
+    size_t nbUp = 0;  // Consecutive samples
+    size_t nbDown = 0;
+    std::unique_lock<std::mutex> guard(_mutexScaler);
+    while (!_cvScaler.wait_for(guard, _scaling.interval, [this]{ return this->_stopScaler; }))
+    {
+        guard.unlock();
+        erase_retired_contexts();
+
+        size_t nbWorkers = _nbWorkers.load();
+        size_t nbWaiting = nb_waiting_inputs();
+        size_t nbIdle = nb_idle_workers();
+        nbUp = nbWaiting >= _scaling.scaleUpDepth + nbIdle ? nbUp + 1 : 0;
+        nbDown = nbWaiting == 0 && nbIdle > _scaling.scaleDownIdle * nbWorkers ? nbDown + 1 : 0;
+
+        if (nbWorkers < _scaling.minWorkers || (nbUp >= _scaling.nbSamples && nbWorkers < _scaling.maxWorkers))
+        {
+            if (_mode == DispatchMode::WORK_STEALING)
+            {
+                std::lock_guard<std::mutex> guardStreams(_mutexStreams);
+                _nbRetiring = 0;  // Cancel the pending retirement
+            }
+            std::lock_guard<std::mutex> guardWorkers(_mutexWorkers);
+            add_worker();
+            nbUp = 0;
+        }
+        else if (nbWorkers > _scaling.maxWorkers || (nbDown >= _scaling.nbSamples && nbWorkers > _scaling.minWorkers))
+        {
+            if (retire_idle_worker())
+            {
+                nbDown = 0;
+            }
+        }
+
+        guard.lock();
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_waiting_inputs()
+{
+    size_t nbWaiting = _nbLocalJobs.load();
+    std::lock_guard<std::mutex> guard(_mutexStreams);
+    for (const std::shared_ptr<Stream>& stream : _streams)
+    {
+        nbWaiting += stream->nbQueuedInputs.load();
+    }
+    return nbWaiting;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_idle_workers()
+{
+    if (_mode == DispatchMode::WORK_STEALING)
+    {
+        return _nbIdleWorkers.load();
+    }
+    return _availableWorkers.size();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::retire_idle_worker()
+{
+    if (_mode == DispatchMode::WORK_STEALING)
+    {
+        // The first idle worker to wake up retires itself (see stealing_job)
+        std::lock_guard<std::mutex> guard(_mutexStreams);
+        if (_nbIdleWorkers.load() == 0 || _nbRetiring > 0)
+        {
+            return false;
+        }
+        ++_nbRetiring;
+        _cvIdle.notify_one();
+        return true;
+    }
+
+    WorkerContext* context = nullptr;
+    if (!_availableWorkers.try_pop(context))  // Cannot be acquired by the scheduler anymore
+    {
+        return false;
+    }
+    if (_mode == DispatchMode::POOL)
+    {
+        context->jobs.push_back(Job{});
+        context->thread.join();
+    }
+    else
+    {
+        std::lock_guard<std::mutex> guard(context->mutexTask);
+        if (context->task.valid())
+        {
+            context->task.wait();  // The worker is released before the end of the task
+        }
+    }
+    remove_worker(context);
+    return true;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::remove_worker(WorkerContext* context)
+{
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    Worker* worker = context->worker;
+    _workers.remove_if([worker](const WorkerPtr& owned) { return owned.get() == worker; });
+    context->worker = nullptr;
+    --_nbWorkers;
+    if (!context->thread.joinable())  // Otherwise, the worker retired itself and is still running (see erase_retired_contexts)
+    {
+        // Deleted now, or with the last snapshot of _activeContexts which
+        // refers to it (ex: a worker looking for a victim)
+        _contexts.remove_if([context](const std::shared_ptr<WorkerContext>& owned) { return owned.get() == context; });
+    }
+    publish_contexts();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::publish_contexts()
+{
+    std::shared_ptr<std::vector<std::shared_ptr<WorkerContext>>> contexts = std::make_shared<std::vector<std::shared_ptr<WorkerContext>>>();
+    for (const std::shared_ptr<WorkerContext>& context : _contexts)
+    {
+        if (context->worker)
+        {
+            contexts->push_back(context);
+        }
+    }
+    std::atomic_store(&_activeContexts, std::shared_ptr<const std::vector<std::shared_ptr<WorkerContext>>>(std::move(contexts)));
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::erase_retired_contexts()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> guard(_mutexWorkers);
+        for (auto context = _contexts.begin() ; context != _contexts.end() ; )
+        {
+            if ((*context)->worker)
+            {
+                ++context;
+                continue;
+            }
+            threads.push_back(std::move((*context)->thread));  // remove_worker is over (the lock is released)
+            context = _contexts.erase(context);
+        }
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class FeederFn>
+auto QueueScheduler<Worker, InputQueue>::launch(FeederFn feeder) -> StreamHandle
+{
+    static_assert(
+        detail::IsItemFeeder<FeederFn, Input>::value || detail::IsBatchFeeder<FeederFn, Input>::value || detail::IsChunkFeeder<FeederFn, Input>::value,
+        "The feeder has to return a std::unique_ptr<Input>, or be a batch feeder FeedStatus(std::vector<std::unique_ptr<Input>>&, size_t) "
+        "or a chunk feeder FeedStatus(size_t, std::vector<std::unique_ptr<Input>>&)"
+    );
+
+    std::lock_guard<std::mutex> guard(_mutexStreams);
+
+    // Forget the streams which are over (the handles keep them alive if needed)
+    _streams.erase(
+        std::remove_if(_streams.begin(), _streams.end(), [this](const std::shared_ptr<Stream>& stream) {
+            return stream != this->_defaultStream && stream->released.load() &&
+                stream->scheduler.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+                stream->feeder.wait_for(std::chrono::seconds(0)) == std::future_status::ready;  // Otherwise would block while locked
+        }),
+        _streams.end()
+    );
+
+    if (_defaultStream->launched)
+    {
+        _defaultStream = std::make_shared<Stream>(_nbStreams++, _maxInputSize, _reorderWindow);
+        JS_STATS(_defaultStream->outputs.set_wait_histogram(&_stats.outputWait);)
+        _defaultStream->outputs.set_ordering(_ordering);
+        apply_wait_policies(*_defaultStream);
+        _streams.push_back(_defaultStream);
+    }
+    Stream* stream = _defaultStream.get();
+    stream->launched = true;
+    trace_stream(*stream);
+
+    // Launch the feeder and the scheduler on other threads
+    stream->feeder = std::async(  // To avoid blocking call, need to capture the future (future has blocking destructor)
+        std::launch::async,
+        &QueueScheduler::feeder_job<FeederFn>, this, // Will call this->feeder_job(stream, feeder)
+        stream,
+        std::move(feeder)
+    );
+    stream->scheduler = std::async(
+        std::launch::async,
+        &QueueScheduler::scheduler_job, this,
+        stream
+    );
+    return StreamHandle(this, _defaultStream);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class Source>
+auto QueueScheduler<Worker, InputQueue>::launch_from(Source& upstream) -> StreamHandle
+{
+    static_assert(
+        std::is_same<typename UpstreamFeeder<Source>::OutputPtr, InputPtr>::value,
+        "The outputs of the upstream stage have to be the inputs of this stage"
+    );
+    if (upstream.reorder_window() == UNLIMITED)
+    {
+        upstream.set_reorder_window(DEFAULT_CHAIN_WINDOW);  // Bound the outputs kept upstream
+    }
+    return launch(UpstreamFeeder<Source>(upstream, &_nbUpstreamErrors));
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_batching(size_t maxBatch, std::chrono::microseconds maxWait)
+{
+    _maxBatch = maxBatch > 0 ? maxBatch : 1;
+    _batchTimeout = maxWait;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_feeder_threads(size_t nbThreads)
+{
+    _nbFeederThreads = nbThreads > 0 ? nbThreads : 1;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_ordering(OrderingMode mode, const KeyFunction& keyFunction)
+{
+    if (mode == OrderingMode::KEYED && !keyFunction)
+    {
+        throw std::invalid_argument("The KEYED ordering requires a key function");
+    }
+    _ordering = mode;
+    _keyFunction = keyFunction;
+
+    std::lock_guard<std::mutex> guard(_mutexStreams);
+    _defaultStream->outputs.set_ordering(mode);  // The next streams are created with the mode
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_ttl(std::chrono::steady_clock::duration ttl)
+{
+    _ttl = ttl;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_deadline(const DeadlineFunction& deadlineFunction)
+{
+    _deadlineFunction = deadlineFunction;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_routing(const RoutingPolicy& policy)
+{
+    if (policy.smoothing <= 0 || policy.smoothing > 1 || policy.holdBack < 0)
+    {
+        throw std::invalid_argument("The routing requires 0 < smoothing <= 1 and holdBack >= 0");
+    }
+    _routing = policy;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_hedging(const HedgingPolicy& policy)
+{
+    if (_mode == DispatchMode::WORK_STEALING)
+    {
+        throw std::logic_error("The hedging requires the ASYNC or POOL mode");
+    }
+    if (policy.percentile <= 0 || policy.percentile > 1 || policy.window == 0)
+    {
+        throw std::invalid_argument("The hedging requires 0 < percentile <= 1 and window > 0");
+    }
+    _hedging = policy;
+    _serviceSamples.reserve(policy.window);
+    _hedgingEnabled = true;
+    if (!_hedger.joinable())
+    {
+        _hedger = std::thread(&QueueScheduler::hedger_job, this);
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_placement(const PlacementPolicy& policy)
+{
+    _placement = policy;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_wait_policy(Handoff handoff, const WaitPolicy& policy)
+{
+    {
+        std::lock_guard<std::mutex> guard(_mutexStreams);
+        _waitPolicies.emplace_back(handoff, policy);
+        for (std::shared_ptr<Stream>& stream : _streams)
+        {
+            apply_wait_policies(*stream);
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    if (handoff == Handoff::WORKERS)
+    {
+        _availableWorkers.set_wait_policy(policy);
+    }
+    for (std::shared_ptr<WorkerContext>& context : _contexts)
+    {
+        apply_wait_policies(*context);
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::input_pool() -> ObjectPool<Input>&
+{
+    return _inputPool;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::output_pool() -> ObjectPool<Output>&
+{
+    return _outputPool;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_recycling(bool recycleInputs)
+{
+    _recycleInputs = recycleInputs;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::scheduler_job(Stream* stream)
+{
+    pin_current_thread(_placement.schedulerCpus);  // No-op if not pinned
+    if (_mode == DispatchMode::WORK_STEALING)
+    {
+        // The idle workers pull the inputs themselves, just wait for the
+        // feeder to expire
+        std::unique_lock<std::mutex> guard(_mutexStreams);
+        _cvExhausted.wait(guard, [stream]{ return stream->exhausted; });
+        return;  // The release token has been pushed by the last worker
+    }
+
+    bool feederAlive = true;
+    while(feederAlive)
+    {
+        Job job;
+        if (!start_job(stream, job, true))  // Get the next input
+        {
+            continue;  // Only expired inputs
+        }
+        if (!job.input)  // Exit when the feeder expire (TODO: Could also add a timeout or other exit conditions)
+        {
+            break;
+        }
+
+        TraceLane::Clock::time_point dispatchStart;
+        if (stream->schedulerLane)
+        {
+            dispatchStart = TraceLane::Clock::now();
+        }
+
+        // In case of exit, even if there has been some threads which did not
+        // finished yet, all previous slots have already been reserved, so the
+        // main program will grab all the frames
+        feederAlive = prepare_job(job);
+        size_t nbInputs = job.batch.empty() ? 1 : job.batch.size();
+
+        JS_STATS(auto acquireStart = std::chrono::steady_clock::now();)
+        WorkerContext* context = acquire_worker(nbInputs);  // Wait for an available worker
+        JS_STATS(_stats.workerAcquire.record(std::chrono::steady_clock::now() - acquireStart);)
+
+        if (stream->schedulerLane)  // Before the handoff, the job can be popped as soon as it is sent
+        {
+            stream->schedulerLane->span("dispatch", dispatchStart, TraceLane::Clock::now(), stream->id, job.sequence, "worker", context->index);
+            for (size_t i = 0 ; i < nbInputs ; ++i)
+            {
+                stream->schedulerLane->flow('t', dispatchStart, stream->id, job.sequence + i);
+            }
+        }
+
+        dispatch_job(context, std::move(job));
+    }
+    release_stream(*stream); // Finally release output queue
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::dispatch_job(WorkerContext* context, Job job)
+{
+    if (_mode == DispatchMode::POOL)
+    {
+        // Send the task to the worker thread
+        context->jobs.push_back(std::move(job));
+    }
+    else
+    {
+        // Launch the task (encapsulate the worker). The previous task of
+        // this worker has released the worker but can still be writing its
+        // outputs, so its future is waited outside the lock (instead of
+        // blocking in the future destructor while holding it)
+        std::future<void> previous;
+        {
+            std::lock_guard<std::mutex> guard(context->mutexTask);
+            previous = std::move(context->task);
+            context->task = std::async(
+                std::launch::async,
+                &QueueScheduler::worker_job, this,
+                context,
+                std::move(job)
+            );
+        }
+        if (previous.valid())
+        {
+            previous.wait();
+        }
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class FeederFn>
+void QueueScheduler<Worker, InputQueue>::feeder_job(Stream* stream, FeederFn feeder)
+{
+    pin_current_thread(_placement.feederCpus);  // No-op if not pinned
+    try
+    {
+        feed(stream, feeder, ProtocolTag<detail::FeederProtocolOf<FeederFn, Input>::value>{});
+    }
+    catch (const ExpiredException& e)
+    {
+    }
+    catch (...)
+    {
+        stream->feederError = std::current_exception();  // Forwarded to pop()
+    }
+
+    // Release input queue
+    ++stream->nbQueuedInputs;
+    stream->inputs.push_back(InputEntry{});  // Without input
+    notify_idle();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class FeederFn>
+void QueueScheduler<Worker, InputQueue>::feed(Stream* stream, FeederFn& feeder, ProtocolTag<FeederProtocol::ITEM>)
+{
+    for (size_t sequence = 0 ; ; ++sequence)  // The inputs are dispatched in order
+    {
+        TraceLane::Clock::time_point produceStart;
+        TraceLane::Clock::time_point produceEnd;
+        if (stream->feederLane)
+        {
+            produceStart = TraceLane::Clock::now();
+        }
+
+        JS_STATS(auto feederStart = std::chrono::steady_clock::now();)
+        InputEntry entry;
+        entry.input = feeder();
+        JS_STATS(entry.enqueued = std::chrono::steady_clock::now();)
+        JS_STATS(_stats.feeder.record(entry.enqueued - feederStart);)
+        if (!entry.input)
+        {
+            return;
+        }
+        entry.deadline = deadline_of(*entry.input, ttl_deadline());
+
+        if (stream->feederLane)
+        {
+            produceEnd = TraceLane::Clock::now();
+            stream->feederLane->span("produce", produceStart, produceEnd, stream->id, sequence);
+            stream->feederLane->flow('s', produceStart, stream->id, sequence);
+        }
+        ++stream->nbQueuedInputs;  // Before the push, otherwise the input could be popped before being counted
+        stream->inputs.push_back(std::move(entry));
+        JS_STATS(_stats.inputDepth.add(1);)  // After the push so the peak don't count the blocked input
+        if (stream->feederLane)
+        {
+            stream->feederLane->span("enqueue", produceEnd, TraceLane::Clock::now(), stream->id, sequence);  // Blocked while the input queue is full
+        }
+        notify_idle();
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class FeederFn>
+void QueueScheduler<Worker, InputQueue>::feed(Stream* stream, FeederFn& feeder, ProtocolTag<FeederProtocol::BATCH>)
+{
+    const size_t maxInputs = _maxInputSize == UNLIMITED ? DEFAULT_FEED_BATCH : _maxInputSize;
+    std::vector<InputPtr> inputs;
+    std::vector<InputEntry> entries;
+    inputs.reserve(maxInputs);
+    entries.reserve(maxInputs);
+
+    FeedStatus status = FeedStatus::MORE;
+    for (size_t sequence = 0 ; status == FeedStatus::MORE ; )
+    {
+        TraceLane::Clock::time_point produceStart;
+        if (stream->feederLane)
+        {
+            produceStart = TraceLane::Clock::now();
+        }
+
+        JS_STATS(auto feederStart = std::chrono::steady_clock::now();)
+        inputs.clear();
+        status = feeder(inputs, maxInputs);
+        JS_STATS(_stats.feeder.record(std::chrono::steady_clock::now() - feederStart);)
+
+        TraceLane::Clock::time_point produceEnd;
+        if (stream->feederLane)
+        {
+            produceEnd = TraceLane::Clock::now();
+        }
+        sequence += push_inputs(stream, stream->feederLane, inputs, entries, sequence, produceStart, produceEnd);
+    }
+
+    if (status == FeedStatus::ERROR)
+    {
+        stream->feederError = std::make_exception_ptr(FeederError());
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class FeederFn>
+void QueueScheduler<Worker, InputQueue>::feed(Stream* stream, FeederFn& feeder, ProtocolTag<FeederProtocol::CHUNK>)
+{
+    ChunkMerge merge;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1 ; i < _nbFeederThreads ; ++i)
+    {
+        TraceLane* lane = stream->feederLane ? &_tracer->add_lane(stream->feederLane->name() + " #" + std::to_string(i)) : nullptr;
+        threads.emplace_back(&QueueScheduler::feed_chunks<FeederFn>, this, stream, std::ref(feeder), std::ref(merge), lane);
+    }
+    feed_chunks(stream, feeder, merge, stream->feederLane);  // This thread is also a feeder thread
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (merge.error)
+    {
+        std::rethrow_exception(merge.error);  // Forwarded to pop() by feeder_job
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class FeederFn>
+void QueueScheduler<Worker, InputQueue>::feed_chunks(Stream* stream, FeederFn& feeder, ChunkMerge& merge, TraceLane* lane)
+{
+    pin_current_thread(_placement.feederCpus);  // The additional feeder threads too
+    std::vector<InputPtr> inputs;
+    std::vector<InputEntry> entries;
+    while (true)
+    {
+        size_t chunk = merge.nextChunk++;
+        {
+            std::lock_guard<std::mutex> guard(merge.mutexTurn);
+            if (chunk > merge.endChunk)
+            {
+                return;  // The end of the source has been reached by another thread
+            }
+        }
+
+        TraceLane::Clock::time_point produceStart;
+        if (lane)
+        {
+            produceStart = TraceLane::Clock::now();
+        }
+
+        JS_STATS(auto feederStart = std::chrono::steady_clock::now();)
+        FeedStatus status = FeedStatus::MORE;
+        std::exception_ptr error;
+        inputs.clear();
+        try
+        {
+            status = feeder(chunk, inputs);
+        }
+        catch (const ExpiredException& e)
+        {
+            status = FeedStatus::END;
+        }
+        catch (...)
+        {
+            status = FeedStatus::ERROR;
+            error = std::current_exception();
+        }
+        JS_STATS(_stats.feeder.record(std::chrono::steady_clock::now() - feederStart);)
+
+        TraceLane::Clock::time_point produceEnd;
+        if (lane)
+        {
+            produceEnd = TraceLane::Clock::now();
+        }
+
+        // Wait for the previous chunks to be pushed
+        std::unique_lock<std::mutex> guard(merge.mutexTurn);
+        merge.cvTurn.wait(guard, [&merge, chunk]{ return merge.nextPush == chunk || chunk > merge.endChunk; });
+        if (chunk > merge.endChunk)
+        {
+            return;  // Produced after the end of the source: dropped
+        }
+        size_t sequence = merge.sequence;
+        guard.unlock();
+
+        size_t nbPushed = push_inputs(stream, lane, inputs, entries, sequence, produceStart, produceEnd);  // No other thread push before nextPush is incremented
+
+        guard.lock();
+        merge.sequence += nbPushed;
+        ++merge.nextPush;
+        if (status != FeedStatus::MORE)
+        {
+            merge.endChunk = chunk;
+            if (status == FeedStatus::ERROR)
+            {
+                merge.error = error ? error : std::make_exception_ptr(FeederError());
+            }
+        }
+        merge.cvTurn.notify_all();
+        if (status != FeedStatus::MORE)
+        {
+            return;
+        }
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::push_inputs(
+    Stream* stream,
+    TraceLane* lane,
+    std::vector<InputPtr>& inputs,
+    std::vector<InputEntry>& entries,
+    size_t sequence,
+    TraceLane::Clock::time_point produceStart,
+    TraceLane::Clock::time_point produceEnd
+)
+{
+    JS_STATS(auto enqueued = std::chrono::steady_clock::now();)
+    Deadline ttlDeadline = ttl_deadline();
+    entries.clear();
+    for (InputPtr& input : inputs)
+    {
+        if (input)  // The empty inputs would be taken for the final token
+        {
+            entries.emplace_back();
+            entries.back().deadline = deadline_of(*input, ttlDeadline);
+            entries.back().input = std::move(input);
+            JS_STATS(entries.back().enqueued = enqueued;)
+        }
+    }
+    inputs.clear();
+    size_t nbEntries = entries.size();
+    if (nbEntries == 0)
+    {
+        return 0;
+    }
+
+    if (lane)
+    {
+        lane->span("produce", produceStart, produceEnd, stream->id, sequence, "inputs", nbEntries);
+        for (size_t i = 0 ; i < nbEntries ; ++i)
+        {
+            lane->flow('s', produceStart, stream->id, sequence + i);
+        }
+    }
+    stream->nbQueuedInputs += nbEntries;  // Before the push, otherwise the inputs could be popped before being counted
+    notify_idle();  // Before the push: a chunk can be larger than the input queue, so the idle workers have to drain it
+    stream->inputs.push_batch(entries);  // Clear entries
+    JS_STATS(_stats.inputDepth.add(nbEntries);)
+    if (lane)
+    {
+        lane->span("enqueue", produceEnd, TraceLane::Clock::now(), stream->id, sequence, "inputs", nbEntries);  // Blocked while the input queue is full
+    }
+    return nbEntries;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::prepare_job(Job& job)
+{
+    bool feederAlive = true;
+
+    size_t maxBatch = _maxBatch;
+    size_t window = job.stream->outputs.max_size();
+    if (window != UNLIMITED)
+    {
+        maxBatch = std::min(maxBatch, window);  // Otherwise the batch would never fit in the window
+    }
+    size_t nbInputs = 1;
+    if (maxBatch > 1)
+    {
+        job.batch.reserve(maxBatch);
+        job.batch.push_back(std::move(job.input));
+        feederAlive = collect_batch(job, maxBatch);
+        nbInputs = job.batch.size();
+    }
+
+    // Stamp the inputs with their position in the output order (wait if
+    // the reorder window is full). The sequences of a batch are consecutive
+    if (job.batch.empty())
+    {
+        job.sequence = job.stream->outputs.reserve(key_of(*job.input));
+    }
+    else
+    {
+        job.sequence = job.stream->outputs.reserve(key_of(*job.batch.front()));
+        for (size_t i = 1 ; i < nbInputs ; ++i)
+        {
+            job.stream->outputs.reserve(key_of(*job.batch[i]));
+        }
+    }
+    JS_STATS(_stats.outputDepth.add(nbInputs);)
+
+    return feederAlive;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::key_of(const Input& input) const
+{
+    return _ordering == OrderingMode::KEYED ? _keyFunction(input) : 0;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::collect_batch(Job& job, size_t maxBatch)
+{
+    // The expired inputs are kept: their slots have to be reserved after the
+    // ones of the previous inputs of the batch
+    auto deadline = std::chrono::steady_clock::now() + _batchTimeout;
+    while (job.batch.size() < maxBatch)
+    {
+        InputEntry entry;
+        auto remaining = deadline - std::chrono::steady_clock::now();
+        if (!pop_input_for(job.stream, entry, std::max(remaining, decltype(remaining)::zero())))
+        {
+            break;  // Timeout: dispatch the incomplete batch
+        }
+        if (!entry.input)
+        {
+            return false;
+        }
+        job.deadline = std::max(job.deadline, entry.deadline);
+        job.batch.push_back(std::move(entry.input));
+    }
+    return true;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::pop_input(Stream* stream) -> InputEntry
+{
+    InputEntry entry = stream->inputs.pop_front();
+    --stream->nbQueuedInputs;
+    JS_STATS(
+        if (entry.input)
+        {
+            _stats.inputDepth.add(-1);
+            _stats.inputWait.record(std::chrono::steady_clock::now() - entry.enqueued);
+        }
+    )
+    return entry;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::pop_input_for(Stream* stream, InputEntry& entry, std::chrono::steady_clock::duration timeout)
+{
+    if (!stream->inputs.pop_for(entry, timeout))
+    {
+        return false;
+    }
+    --stream->nbQueuedInputs;
+    JS_STATS(
+        if (entry.input)
+        {
+            _stats.inputDepth.add(-1);
+            _stats.inputWait.record(std::chrono::steady_clock::now() - entry.enqueued);
+        }
+    )
+    return true;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::start_job(Stream* stream, Job& job, bool wait)
+{
+    while (true)
+    {
+        InputEntry entry;
+        if (wait)
+        {
+            entry = pop_input(stream);
+        }
+        else if (!pop_input_for(stream, entry, std::chrono::steady_clock::duration::zero()))
+        {
+            return false;
+        }
+
+        if (!entry.input || !is_expired(entry.deadline))
+        {
+            job = Job{stream, 0, std::move(entry.input), {}, entry.deadline, nullptr};
+            return true;
+        }
+        drop_input(stream, std::move(entry.input));  // Without waiting for a worker
+
+        // Don't wait for the next input of the feeder if the caller could do
+        // something else (WORK_STEALING), nor drop several inputs without
+        // checking the reorder window
+        if (!wait || stream->nbQueuedInputs.load() == 0)
+        {
+            return false;
+        }
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::ttl_deadline() const -> Deadline
+{
+    if (_ttl == std::chrono::steady_clock::duration::zero())
+    {
+        return Deadline::max();  // Don't read the clock
+    }
+    return std::chrono::steady_clock::now() + _ttl;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::deadline_of(const Input& input, Deadline ttlDeadline) const -> Deadline
+{
+    return _deadlineFunction ? std::min(ttlDeadline, _deadlineFunction(input)) : ttlDeadline;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::is_expired(Deadline deadline)
+{
+    return deadline != Deadline::max() && deadline <= std::chrono::steady_clock::now();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::drop_input(Stream* stream, InputPtr input)
+{
+    size_t sequence = stream->outputs.reserve(key_of(*input));  // Keep its place in the output order
+    stream->outputs.set_dropped(sequence);
+    ++_nbDropped;
+    if (stream->schedulerLane)
+    {
+        TraceLane::Clock::time_point now = TraceLane::Clock::now();
+        stream->schedulerLane->instant("dropped", now, stream->id, sequence);
+        stream->schedulerLane->flow('f', now, stream->id, sequence);
+    }
+    if (_recycleInputs)
+    {
+        _inputPool.release(std::move(input));
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::acquire_worker(size_t nbInputs) -> WorkerContext*
+{
+    std::unique_lock<std::mutex> guard(_mutexTurn);
+    size_t ticket = _nextTicket++;
+    _cvTurn.wait(guard, [this, ticket]{ return this->_servedTicket == ticket; });
+    guard.unlock();
+
+    // Only the stream of the current turn waits here
+    WorkerContext* context = _routing.costAware ? acquire_fastest(nbInputs) : _availableWorkers.pop_front();
+
+    guard.lock();
+    ++_servedTicket;
+    _cvTurn.notify_all();
+    return context;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::acquire_fastest(size_t nbInputs) -> WorkerContext*
+{
+    WorkerContext* context = _availableWorkers.pop_select([](const typename QueueThread<WorkerContext*>::List& idle) {
+        return std::min_element(idle.begin(), idle.end(), [](const WorkerContext* lhs, const WorkerContext* rhs) {
+            return lhs->cost.load(std::memory_order_relaxed) < rhs->cost.load(std::memory_order_relaxed);
+        });
+    });
+
+    int64_t now = now_ns();
+    int64_t idleCost = context->cost.load(std::memory_order_relaxed) * static_cast<int64_t>(nbInputs);
+    int64_t busyCost = _routing.holdBack > 0 && idleCost > 0 ? expected_busy_cost(context, nbInputs, now) : 0;
+    if (busyCost > 0 && busyCost * _routing.holdBack < idleCost)
+    {
+        // Keep the idle worker while waiting, it is the fallback. Waiting
+        // longer than idleCost - busyCost would be slower than not waiting
+        ++_nbHeldBack;
+        double maxCost = idleCost / _routing.holdBack / nbInputs;
+        WorkerContext* faster = nullptr;
+        if (_availableWorkers.pop_select_until(
+            faster,
+            [maxCost](const typename QueueThread<WorkerContext*>::List& idle) {
+                return std::find_if(idle.begin(), idle.end(), [maxCost](const WorkerContext* candidate) {
+                    int64_t cost = candidate->cost.load(std::memory_order_relaxed);
+                    return cost > 0 && cost <= maxCost;
+                });
+            },
+            std::chrono::steady_clock::now() + std::chrono::nanoseconds(idleCost - busyCost)
+        ))
+        {
+            _availableWorkers.push_back(context);
+            context = faster;
+            now = now_ns();
+        }
+    }
+
+    context->busySince.store(now, std::memory_order_relaxed);
+    return context;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+int64_t QueueScheduler<Worker, InputQueue>::expected_busy_cost(const WorkerContext* idle, size_t nbInputs, int64_t now)
+{
+    int64_t best = 0;
+    std::shared_ptr<const std::vector<std::shared_ptr<WorkerContext>>> contexts = std::atomic_load(&_activeContexts);
+    for (const std::shared_ptr<WorkerContext>& context : *contexts)
+    {
+        int64_t cost = context->cost.load(std::memory_order_relaxed);
+        int64_t busySince = context->busySince.load(std::memory_order_relaxed);
+        if (context.get() == idle || cost == 0 || busySince == 0)  // Idle ones are slower than the fastest idle
+        {
+            continue;
+        }
+        int64_t expected = std::max<int64_t>(0, busySince + cost - now) + cost * static_cast<int64_t>(nbInputs);
+        if (best == 0 || expected < best)
+        {
+            best = std::max<int64_t>(expected, 1);
+        }
+    }
+    return best;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::update_cost(WorkerContext* context, std::chrono::steady_clock::time_point start, size_t nbInputs)
+{
+    // Only updated by the thread running the worker
+    int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / static_cast<int64_t>(nbInputs);
+    int64_t cost = context->cost.load(std::memory_order_relaxed);
+    cost = cost == 0 ? sample : cost + static_cast<int64_t>(_routing.smoothing * (sample - cost));
+    context->cost.store(std::max<int64_t>(cost, 1), std::memory_order_relaxed);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+int64_t QueueScheduler<Worker, InputQueue>::now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::worker_job(WorkerContext* context, Job job)
+{
+    Stream* stream = job.stream;  // Not accessed by an attempt which lost (the stream can be over)
+    std::shared_ptr<Attempts> attempts = std::move(job.attempts);
+    bool speculative = static_cast<bool>(attempts);  // Re-execution of a running job
+    size_t streamId = speculative ? attempts->streamId : stream->id;
+    size_t nbInputs = speculative ? attempts->nbInputs : (job.batch.empty() ? 1 : job.batch.size());
+    if (_mode == DispatchMode::ASYNC)
+    {
+        pin_current_thread(context->cpus);  // New thread for each job
+    }
+    if (!speculative && is_expired(job.deadline))  // Expired while waiting for the worker
+    {
+        if (context->lane)
+        {
+            TraceLane::Clock::time_point now = TraceLane::Clock::now();
+            context->lane->instant("dropped", now, streamId, job.sequence);
+            for (size_t i = 0 ; i < nbInputs ; ++i)
+            {
+                context->lane->flow('f', now, streamId, job.sequence + i);
+            }
+        }
+        release_inputs(job);
+        release_worker(context);
+        _nbDropped += nbInputs;
+        JS_STATS(_stats.outputDepth.add(-static_cast<int64_t>(nbInputs));)  // Not popped
+        for (size_t i = 0 ; i < nbInputs ; ++i)
+        {
+            stream->outputs.set_dropped(job.sequence + i);
+        }
+        return;
+    }
+    if (_hedgingEnabled && !speculative)
+    {
+        attempts = start_attempts(std::move(job), streamId, nbInputs);
+    }
+    const Job& source = attempts ? attempts->job : job;  // Owns the inputs
+
+    std::chrono::steady_clock::time_point processStart;  // Used by the routing and the hedging
+
+    // Steps already done when an exception is thrown (each one should only be done once)
+    bool attemptEnded = false;
+    bool completed = false;
+    bool inputsReleased = false;
+    bool workerReleased = false;
+    size_t nbSet = 0;  // Output slots already released
+    try
+    {
+        // Launch the task
+        TraceLane::Clock::time_point runStart;
+        if (context->lane)
+        {
+            runStart = TraceLane::Clock::now();
+        }
+        if (_routing.costAware || attempts)
+        {
+            processStart = std::chrono::steady_clock::now();
+        }
+        JS_STATS(auto serviceStart = std::chrono::steady_clock::now();)
+        JS_STATS(context->stats->nbInputs.fetch_add(nbInputs, std::memory_order_relaxed);)
+        if (source.batch.empty())
+        {
+            OutputPtr output = Traits::process(*context->worker, *source.input.get());
+            JS_STATS(context->stats->service.record(std::chrono::steady_clock::now() - serviceStart);)
+            if (_routing.costAware)
+            {
+                update_cost(context, processStart, nbInputs);
+            }
+            completed = !attempts || end_attempt(attempts, processStart, true, speculative);
+            attemptEnded = true;
+            trace_run(context, runStart, streamId, source.sequence, nbInputs, completed);
+            if (!attempts)
+            {
+                inputsReleased = true;
+                release_inputs(job);
+            }
+
+            // The worker finished its job, so can be used again
+            workerReleased = true;
+            release_worker(context);
+
+            // Release the slot (the output of an attempt which lost is discarded)
+            if (completed)
+            {
+                stream->outputs.set(source.sequence, std::move(output));
+                ++nbSet;
+            }
+        }
+        else
+        {
+            std::vector<const Input*> inputs;
+            inputs.reserve(nbInputs);
+            for (const InputPtr& input : source.batch)
+            {
+                inputs.push_back(input.get());
+            }
+
+            std::vector<OutputPtr> outputs = Traits::process_batch(*context->worker, inputs);
+            JS_STATS(context->stats->service.record(std::chrono::steady_clock::now() - serviceStart);)
+            if (_routing.costAware)
+            {
+                update_cost(context, processStart, nbInputs);
+            }
+            if (outputs.size() != nbInputs)
+            {
+                throw std::length_error("process_batch has to return one output per input");
+            }
+            completed = !attempts || end_attempt(attempts, processStart, true, speculative);
+            attemptEnded = true;
+            trace_run(context, runStart, streamId, source.sequence, nbInputs, completed);
+            if (!attempts)
+            {
+                inputsReleased = true;
+                release_inputs(job);
+            }
+
+            workerReleased = true;
+            release_worker(context);
+
+            for ( ; completed && nbSet < nbInputs ; ++nbSet)
+            {
+                stream->outputs.set(source.sequence + nbSet, std::move(outputs[nbSet]));
+            }
+        }
+    }
+    catch (...)
+    {
+        // The exception is forwarded to pop()
+        if (!attemptEnded)
+        {
+            completed = !attempts || end_attempt(attempts, processStart, false, speculative);
+        }
+        if (!attempts && !inputsReleased)
+        {
+            release_inputs(job);
+        }
+        if (!workerReleased)
+        {
+            // Once released, the lane can already be used by the next job of the worker
+            if (context->lane)
+            {
+                context->lane->instant(completed ? "error" : "discarded error", TraceLane::Clock::now(), streamId, source.sequence);
+            }
+            release_worker(context);
+        }
+        for (size_t i = nbSet ; completed && i < nbInputs ; ++i)
+        {
+            stream->outputs.set_exception(source.sequence + i, std::current_exception());
+        }
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::hedger_job()
+{
+    pin_current_thread(_placement.schedulerCpus);  // No-op if not pinned
+    std::unique_lock<std::mutex> guard(_mutexHedging);
+    while (!_cvHedging.wait_for(guard, _hedging.interval, [this]{ return this->_stopHedger; }))
+    {
+        while (std::shared_ptr<Attempts> straggler = find_straggler())
+        {
+            WorkerContext* context = nullptr;
+            if (!_availableWorkers.try_pop(context))
+            {
+                // All the workers are busy: take the next released one
+                // (before the streams)
+                guard.unlock();
+                context = wait_released_worker();
+                guard.lock();
+                if (!context)
+                {
+                    break;
+                }
+            }
+            hedge(straggler, context);
+        }
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::find_straggler() -> std::shared_ptr<Attempts>
+{
+    if (_runningJobs.empty() || _serviceSamples.empty() || _serviceSamples.size() < _hedging.minSamples)
+    {
+        return nullptr;
+    }
+
+    std::vector<int64_t> samples = _serviceSamples;
+    size_t rank = std::min(static_cast<size_t>(_hedging.percentile * (samples.size() - 1) + 0.5), samples.size() - 1);
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    std::chrono::nanoseconds threshold(samples[rank]);
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::vector<size_t> streams;  // Whose oldest running job has been checked
+    for (const std::shared_ptr<Attempts>& attempts : _runningJobs)
+    {
+        // The jobs of a stream are started in order, so the first one is the
+        // oldest, the one which blocks the output
+        if (std::find(streams.begin(), streams.end(), attempts->streamId) != streams.end())
+        {
+            continue;
+        }
+        streams.push_back(attempts->streamId);
+        if (!attempts->hedged && !attempts->finished.load() && now - attempts->start >= threshold * attempts->nbInputs)
+        {
+            return attempts;
+        }
+    }
+    return nullptr;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::wait_released_worker() -> WorkerContext*
+{
+    _hedgeRequested = true;
+    WorkerContext* context = nullptr;
+    if (_hedgeHandoff.pop_for(context, _hedging.interval))
+    {
+        return context;
+    }
+    if (!_hedgeRequested.exchange(false))  // A worker is being handed over
+    {
+        return _hedgeHandoff.pop_front();
+    }
+    return nullptr;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::hedge(const std::shared_ptr<Attempts>& attempts, WorkerContext* context)
+{
+    attempts->hedged = true;  // Never retried
+
+    // Only if an attempt is still running, otherwise the inputs are released
+    size_t nbRunning = attempts->nbRunning.load();
+    while (nbRunning > 0 && !attempts->nbRunning.compare_exchange_weak(nbRunning, nbRunning + 1))
+    {
+    }
+    if (nbRunning == 0)
+    {
+        release_worker(context);
+        return;
+    }
+
+    ++_nbHedged;
+    if (_routing.costAware)
+    {
+        context->busySince.store(now_ns(), std::memory_order_relaxed);
+    }
+
+    Job job;
+    job.stream = attempts->job.stream;
+    job.sequence = attempts->job.sequence;
+    job.deadline = attempts->job.deadline;
+    job.attempts = attempts;
+    dispatch_job(context, std::move(job));
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::start_attempts(Job job, size_t streamId, size_t nbInputs) -> std::shared_ptr<Attempts>
+{
+    std::shared_ptr<Attempts> attempts = std::make_shared<Attempts>(std::move(job), streamId, nbInputs);
+    std::lock_guard<std::mutex> guard(_mutexHedging);
+    _runningJobs.push_back(attempts);
+    return attempts;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::end_attempt(
+    const std::shared_ptr<Attempts>& attempts,
+    std::chrono::steady_clock::time_point start,
+    bool success,
+    bool speculative
+)
+{
+    size_t nbRunning = --attempts->nbRunning;
+    bool completed = (success || nbRunning == 0) && !attempts->finished.exchange(true);
+    {
+        std::lock_guard<std::mutex> guard(_mutexHedging);
+        if (success)
+        {
+            int64_t sample = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / static_cast<int64_t>(attempts->nbInputs);
+            if (_serviceSamples.size() < _hedging.window)
+            {
+                _serviceSamples.push_back(sample);
+            }
+            else
+            {
+                _serviceSamples[_nextSample] = sample;
+                _nextSample = (_nextSample + 1) % _hedging.window;
+            }
+        }
+        if (completed)
+        {
+            _runningJobs.remove(attempts);
+        }
+    }
+    if (completed && speculative)
+    {
+        ++_nbHedgesWon;
+    }
+    if (nbRunning == 0)
+    {
+        release_inputs(attempts->job);
+    }
+    return completed;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::release_inputs(Job& job)
+{
+    if (!_recycleInputs)
+    {
+        return;  // Deleted with the job
+    }
+    _inputPool.release(std::move(job.input));
+    for (InputPtr& input : job.batch)
+    {
+        _inputPool.release(std::move(input));
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::trace_run(
+    WorkerContext* context,
+    TraceLane::Clock::time_point runStart,
+    size_t streamId,
+    size_t sequence,
+    size_t nbInputs,
+    bool completed
+)
+{
+    if (!context->lane)
+    {
+        return;
+    }
+    TraceLane::Clock::time_point runEnd = TraceLane::Clock::now();
+    if (!completed)  // Another attempt of the job finished first
+    {
+        context->lane->span("discarded", runStart, runEnd, streamId, sequence, "inputs", nbInputs);
+        return;
+    }
+    context->lane->span("run", runStart, runEnd, streamId, sequence, "inputs", nbInputs);
+    for (size_t i = 0 ; i < nbInputs ; ++i)
+    {
+        context->lane->flow('t', runStart, streamId, sequence + i);
+    }
+    context->lane->instant("complete", runEnd, streamId, sequence);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::pool_job(WorkerContext* context)
+{
+    pin_current_thread(context->cpus);  // No-op if not pinned
+    while (true)
+    {
+        Job job = context->jobs.pop_front();
+        if (!job.input && job.batch.empty() && !job.attempts)  // Stop token
+        {
+            break;
+        }
+        worker_job(context, std::move(job));
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::stealing_job(WorkerContext* context)
+{
+    pin_current_thread(context->cpus);  // No-op if not pinned
+    bool retired = false;
+    while (true)
+    {
+        Job job;
+        if (pop_local(context, job) || steal(context, job) || refill(context, job))
+        {
+            worker_job(context, std::move(job));
+            continue;
+        }
+
+        // Nothing to do: wait for new jobs to steal or for new inputs
+        std::unique_lock<std::mutex> guard(_mutexStreams);
+        if (_stopping && _nbLocalJobs.load() == 0)  // The remaining running jobs are finished by their owner
+        {
+            break;
+        }
+        if (_nbRetiring > 0)  // Between two jobs and with an empty local queue
+        {
+            --_nbRetiring;
+            retired = true;
+            break;
+        }
+        ++_nbIdleWorkers;  // Before checking the predicate (see notify_idle)
+        _cvIdle.wait(guard, [this]{ return this->_nbLocalJobs.load() > 0 || this->next_refill_stream() || this->_stopping || this->_nbRetiring > 0; });
+        --_nbIdleWorkers;
+    }
+
+    if (retired)
+    {
+        remove_worker(context);
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::pop_local(WorkerContext* context, Job& job)
+{
+    std::lock_guard<std::mutex> guard(context->mutexLocal);
+    if (context->localJobs.empty())
+    {
+        return false;
+    }
+    job = std::move(context->localJobs.front());
+    context->localJobs.pop_front();
+    --_nbLocalJobs;
+    return true;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::steal(WorkerContext* context, Job& job)
+{
+    if (_nbLocalJobs.load() == 0)
+    {
+        return false;
+    }
+
+    // Start from the next worker, so the victims are spread. The oldest job is
+    // stolen, as it is the first one to block the output
+    std::shared_ptr<const std::vector<std::shared_ptr<WorkerContext>>> victims = std::atomic_load(&_activeContexts);  // Not retired
+    for (int pass = 0 ; pass < 2 ; ++pass)
+    {
+        for (const std::shared_ptr<WorkerContext>& owned : *victims)
+        {
+            WorkerContext* victim = owned.get();
+            bool after = victim->index > context->index;
+            if (victim == context || after != (pass == 0))
+            {
+                continue;
+            }
+            if (pop_local(victim, job))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::refill(WorkerContext* context, Job& job)
+{
+    Stream* stream = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(_mutexStreams);
+        stream = next_refill_stream();
+        if (!stream)
+        {
+            return false;
+        }
+        stream->refilling = true;  // Only one worker pulls a stream at a time (as the scheduler thread would)
+        ++_refillCursor;  // The next refill starts from the next stream
+    }
+
+    TraceLane::Clock::time_point refillStart;
+    if (stream->schedulerLane)
+    {
+        refillStart = TraceLane::Clock::now();
+    }
+
+    bool feederAlive = true;
+    size_t nbJobs = 0;
+    bool started = start_job(stream, job, true);  // Already pushed (false if only expired inputs)
+    if (started && job.input)
+    {
+        feederAlive = prepare_job(job);
+        ++nbJobs;
+
+        // Also pull the inputs already available, as long as their slots can
+        // be reserved without blocking. Otherwise the worker could wait for
+        // the window while having the head job in its own queue
+        while (feederAlive && nbJobs < WORK_STEALING_REFILL && stream->outputs.nb_free() >= _maxBatch)
+        {
+            Job extra;
+            if (!start_job(stream, extra, false))
+            {
+                break;
+            }
+            if (!extra.input)
+            {
+                feederAlive = false;
+                break;
+            }
+            feederAlive = prepare_job(extra);
+            ++nbJobs;
+
+            std::lock_guard<std::mutex> guard(context->mutexLocal);
+            context->localJobs.push_back(std::move(extra));
+            ++_nbLocalJobs;
+        }
+    }
+    else if (started)
+    {
+        feederAlive = false;
+    }
+
+    if (stream->schedulerLane && nbJobs > 0)
+    {
+        stream->schedulerLane->span("refill", refillStart, TraceLane::Clock::now(), stream->id, job.sequence, "worker", context->index);
+    }
+    if (!feederAlive)
+    {
+        release_stream(*stream);  // All the slots have been reserved
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(_mutexStreams);
+        stream->refilling = false;
+        stream->exhausted = stream->exhausted || !feederAlive;
+    }
+    if (!feederAlive)
+    {
+        _cvExhausted.notify_all();
+    }
+    if (nbJobs > 1)
+    {
+        _cvIdle.notify_all();  // Jobs to steal
+    }
+    else
+    {
+        _cvIdle.notify_one();  // Another worker can pull
+    }
+    return nbJobs > 0;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::next_refill_stream() -> Stream*
+{
+    for (size_t i = 0 ; i < _streams.size() ; ++i)
+    {
+        Stream* stream = _streams[(_refillCursor + i) % _streams.size()].get();
+        if (stream->nbQueuedInputs.load() > 0 && !stream->refilling && !stream->exhausted)
+        {
+            _refillCursor += i;
+            return stream;
+        }
+    }
+    return nullptr;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::notify_idle()
+{
+    if (_mode != DispatchMode::WORK_STEALING)
+    {
+        return;
+    }
+    // The fence ensure that either the idle worker see the new input, or we
+    // see the idle worker
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_nbIdleWorkers.load() > 0)
+    {
+        std::lock_guard<std::mutex> guard(_mutexStreams);
+        _cvIdle.notify_one();
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::release_worker(WorkerContext* context)
+{
+    if (_mode != DispatchMode::WORK_STEALING)
+    {
+        if (_routing.costAware)
+        {
+            context->busySince.store(0, std::memory_order_relaxed);
+        }
+        if (_hedgingEnabled && _hedgeRequested.load() && _hedgeRequested.exchange(false))
+        {
+            _hedgeHandoff.push_back(context);  // To re-execute a straggler
+            return;
+        }
+        _availableWorkers.push_back(context);
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::push_release()
+{
+    // TODO: Make sure this function is called only once ? <= In that case,
+    // be sure to reinitialize when calling launch again
+    release_stream(*default_stream());
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::release_stream(Stream& stream)
+{
+    if (stream.feederError)
+    {
+        stream.outputs.set_exception(stream.outputs.reserve(BARRIER_KEY), stream.feederError);  // Also after all the outputs
+        JS_STATS(_stats.outputDepth.add(1);)
+        stream.feederError = nullptr;
+    }
+    stream.outputs.set(stream.outputs.reserve(BARRIER_KEY), OutputPtr(nullptr));  // Popped after all the outputs
+    JS_STATS(_stats.outputDepth.add(1);)
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::recycle(OutputPtr output)
+{
+    _outputPool.release(std::move(output));
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::pop() -> OutputPtr
+{
+    return pop_stream(*default_stream());
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::pop(JobStatus& status) -> OutputPtr
+{
+    return pop_stream(*default_stream(), status);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+bool QueueScheduler<Worker, InputQueue>::try_pop(OutputPtr& output)
+{
+    return pop_stream_for(*default_stream(), output, std::chrono::nanoseconds::zero());
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class Rep, class Period>
+bool QueueScheduler<Worker, InputQueue>::pop_for(OutputPtr& output, const std::chrono::duration<Rep, Period>& timeout)
+{
+    return pop_stream_for(*default_stream(), output, timeout);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::pop_batch(std::vector<OutputPtr>& outputs, size_t maxOutputs)
+{
+    return pop_stream_batch(*default_stream(), outputs, maxOutputs);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::pop_stream(Stream& stream) -> OutputPtr
+{
+    TraceLane::Clock::time_point traceStart;
+    if (stream.consumerLane)
+    {
+        traceStart = TraceLane::Clock::now();
+    }
+
+    JS_STATS(auto popStart = std::chrono::steady_clock::now();)
+    size_t sequence = 0;
+    OutputPtr output = stream.outputs.pop_front(&sequence);  // Will wait for the worker to finish
+    JS_STATS(_stats.pop.record(std::chrono::steady_clock::now() - popStart);)
+    JS_STATS(_stats.outputDepth.add(-1);)
+
+    on_popped(stream, output, sequence, traceStart);
+    return output;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::pop_stream(Stream& stream, JobStatus& status) -> OutputPtr
+{
+    TraceLane::Clock::time_point traceStart;
+    if (stream.consumerLane)
+    {
+        traceStart = TraceLane::Clock::now();
+    }
+
+    JS_STATS(auto popStart = std::chrono::steady_clock::now();)
+    bool dropped = false;
+    size_t sequence = 0;
+    OutputPtr output = stream.outputs.pop_front(dropped, &sequence);
+    JS_STATS(_stats.pop.record(std::chrono::steady_clock::now() - popStart);)
+    if (dropped)
+    {
+        status = JobStatus::DROPPED;  // Already removed from the output depth
+        return output;
+    }
+    JS_STATS(_stats.outputDepth.add(-1);)
+
+    on_popped(stream, output, sequence, traceStart);
+    status = output ? JobStatus::DONE : JobStatus::RELEASED;
+    return output;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+template <class Rep, class Period>
+bool QueueScheduler<Worker, InputQueue>::pop_stream_for(Stream& stream, OutputPtr& output, const std::chrono::duration<Rep, Period>& timeout)
+{
+    TraceLane::Clock::time_point traceStart;
+    if (stream.consumerLane)
+    {
+        traceStart = TraceLane::Clock::now();
+    }
+
+    JS_STATS(auto popStart = std::chrono::steady_clock::now();)
+    OutputPtr popped;
+    size_t sequence = 0;
+    if (!stream.outputs.pop_front_for(popped, timeout, &sequence))
+    {
+        return false;
+    }
+    JS_STATS(_stats.pop.record(std::chrono::steady_clock::now() - popStart);)
+    JS_STATS(_stats.outputDepth.add(-1);)
+
+    on_popped(stream, popped, sequence, traceStart);
+    output = std::move(popped);
+    return true;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::pop_stream_batch(Stream& stream, std::vector<OutputPtr>& outputs, size_t maxOutputs)
+{
+    TraceLane::Clock::time_point traceStart;
+    if (stream.consumerLane)
+    {
+        traceStart = TraceLane::Clock::now();
+    }
+
+    JS_STATS(auto popStart = std::chrono::steady_clock::now();)
+    size_t first = outputs.size();
+    std::vector<size_t>* sequences = stream.consumerLane ? &stream.poppedSequences : nullptr;
+    stream.poppedSequences.clear();
+    size_t nbPopped = stream.outputs.pop_batch(outputs, maxOutputs, sequences);  // Will wait for the first output
+    JS_STATS(_stats.pop.record(std::chrono::steady_clock::now() - popStart);)
+    JS_STATS(_stats.outputDepth.add(-static_cast<int64_t>(nbPopped));)
+
+    for (size_t i = first ; i < outputs.size() ; ++i)
+    {
+        on_popped(stream, outputs[i], sequences ? (*sequences)[i - first] : 0, traceStart);
+    }
+    return nbPopped;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::on_popped(Stream& stream, const OutputPtr& output, size_t sequence, TraceLane::Clock::time_point traceStart)
+{
+    if (!output)  // Release token
+    {
+        stream.released = true;
+    }
+    else if (stream.consumerLane)
+    {
+        // The sequence of the popped slot (with the KEYED and UNORDERED
+        // ordering, the outputs are not popped in the sequence order)
+        stream.consumerLane->span("pop", traceStart, TraceLane::Clock::now(), stream.id, sequence);
+        stream.consumerLane->flow('f', traceStart, stream.id, sequence);
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::default_stream() -> std::shared_ptr<Stream>
+{
+    std::lock_guard<std::mutex> guard(_mutexStreams);
+    return _defaultStream;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::trace_stream(Stream& stream)
+{
+    if (!_tracer || stream.feederLane)
+    {
+        return;
+    }
+    std::string suffix = stream.id == 0 ? "" : " " + std::to_string(stream.id);
+    stream.feederLane = &_tracer->add_lane("feeder" + suffix);
+    stream.schedulerLane = &_tracer->add_lane("scheduler" + suffix);
+    stream.consumerLane = &_tracer->add_lane("pop" + suffix);
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::apply_wait_policies(Stream& stream)
+{
+    for (const std::pair<Handoff, WaitPolicy>& policy : _waitPolicies)
+    {
+        if (policy.first == Handoff::INPUTS)
+        {
+            stream.inputs.set_wait_policy(policy.second);
+        }
+        else if (policy.first == Handoff::OUTPUTS)
+        {
+            stream.outputs.set_wait_policy(policy.second);
+        }
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::apply_wait_policies(WorkerContext& context)
+{
+    for (const std::pair<Handoff, WaitPolicy>& policy : _waitPolicies)
+    {
+        if (policy.first == Handoff::JOBS)
+        {
+            context.jobs.set_wait_policy(policy.second);
+        }
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+auto QueueScheduler<Worker, InputQueue>::get_workers() -> const std::list<WorkerPtr>&
+{
+    return _workers;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::set_reorder_window(size_t window)
+{
+    std::lock_guard<std::mutex> guard(_mutexStreams);
+    _reorderWindow = window;
+    for (std::shared_ptr<Stream>& stream : _streams)
+    {
+        stream->outputs.set_max_size(window);
+    }
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::reorder_window()
+{
+    std::lock_guard<std::mutex> guard(_mutexStreams);
+    return _reorderWindow;
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::peak_out_of_order()
+{
+    return default_stream()->outputs.peak_out_of_order();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::window_stalls()
+{
+    return default_stream()->outputs.nb_full_stalls();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+std::chrono::nanoseconds QueueScheduler<Worker, InputQueue>::window_stalls_duration()
+{
+    return default_stream()->outputs.full_stalls_duration();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_dropped() const
+{
+    return _nbDropped.load();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_upstream_errors() const
+{
+    return _nbUpstreamErrors.load();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_held_back() const
+{
+    return _nbHeldBack.load();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_hedged() const
+{
+    return _nbHedged.load();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+size_t QueueScheduler<Worker, InputQueue>::nb_hedges_won() const
+{
+    return _nbHedgesWon.load();
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+const SchedulerStats& QueueScheduler<Worker, InputQueue>::stats() const
+{
+#ifdef JS_ENABLE_STATS
+    return _stats;
+#else
+    static const SchedulerStats notRecorded;  // Shared by all the schedulers, always empty
+    return notRecorded;
+#endif
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::enable_tracing(size_t nbReservedEvents)
+{
+    _tracer.reset(new JobTracer(nbReservedEvents));
+    for (std::shared_ptr<WorkerContext>& context : _contexts)  // Workers already added
+    {
+        context->lane = &_tracer->add_lane("worker " + std::to_string(context->index));
+    }
+    // The lanes of the streams are created when launched
+}
+
+
+template <class Worker, template <typename> class InputQueue>
+void QueueScheduler<Worker, InputQueue>::write_trace(std::ostream& os) const
+{
+    if (_tracer)
+    {
+        _tracer->write_json(os);
+    }
+    else
+    {
+        JobTracer().write_json(os);  // Empty timeline
+    }
+}
+
 
 } // End namespace
 
@@ -2,8 +2,15 @@
 #define JS_QUEUETHREAD_H
 
 #include <list>
+#include <chrono>
+#include <cstddef>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <utility>
+#include <vector>
+
+#include "waitstrategy.hpp"
 
 
 namespace job_scheduler
@@ -13,6 +20,81 @@ namespace job_scheduler
 constexpr size_t UNLIMITED = 0;
 
 
+namespace detail
+{
+
+/** Raw memory of the popped list nodes, kept for the next pushes. Only blocks
+  * of the same size are cached (a list only allocates its node type)
+  */
+struct NodeCache
+{
+    NodeCache(size_t maxBlocks) : blocks(), blockSize(0), maxBlocks(maxBlocks) {}
+    NodeCache(const NodeCache&) = delete;
+    NodeCache& operator=(const NodeCache&) = delete;
+    ~NodeCache()
+    {
+        for (void* block : blocks)
+        {
+            ::operator delete(block);
+        }
+    }
+
+    std::vector<void*> blocks;
+    size_t blockSize;
+    size_t maxBlocks;
+};
+
+/** Allocator of the QueueThread list. A deallocated node goes back to the
+  * cache (the element has already been destroyed), so T keeps the requirements
+  * of a plain std::list. Not thread safe: the queue lock has to be acquired
+  */
+template <typename U>
+class RecyclingAllocator
+{
+public:
+    typedef U value_type;
+
+    explicit RecyclingAllocator(NodeCache* cache) : _cache(cache) {}
+    template <typename V>
+    RecyclingAllocator(const RecyclingAllocator<V>& other) : _cache(other._cache) {}
+
+    U* allocate(size_t n)
+    {
+        if (n == 1 && !_cache->blocks.empty() && _cache->blockSize == sizeof(U))
+        {
+            void* block = _cache->blocks.back();
+            _cache->blocks.pop_back();
+            return static_cast<U*>(block);
+        }
+        return static_cast<U*>(::operator new(n * sizeof(U)));
+    }
+
+    void deallocate(U* ptr, size_t n)
+    {
+        if (n == 1 && _cache->blocks.size() < _cache->maxBlocks && (_cache->blocks.empty() || _cache->blockSize == sizeof(U)))
+        {
+            _cache->blockSize = sizeof(U);
+            _cache->blocks.push_back(ptr);
+            return;
+        }
+        ::operator delete(ptr);
+    }
+
+    template <typename V>
+    bool operator==(const RecyclingAllocator<V>& other) const { return _cache == other._cache; }
+    template <typename V>
+    bool operator!=(const RecyclingAllocator<V>& other) const { return _cache != other._cache; }
+
+private:
+    template <typename V>
+    friend class RecyclingAllocator;
+
+    NodeCache* _cache;
+};
+
+} // End namespace detail
+
+
 /** Thread safe queue implementation.
   * Push and pop can be called from any thread
   * The pop call is blocking while the queue is empty. WARNING: It should only
@@ -20,12 +102,21 @@ constexpr size_t UNLIMITED = 0;
   * sequencially !
   * The push call is blocking if the maxSize parameter has been set. The maxSize
   * parameter control the maximum size for the queue.
+  * The memory of the list nodes is recycled, so once the queue has reached its
+  * usual size, the push and pop calls don't allocate anymore. A popped element
+  * is still destroyed at once (only the raw memory is kept), and at most
+  * MAX_FREE_NODES nodes are kept (the ones beyond are deleted), so a burst
+  * does not keep its peak memory for the life of the queue.
+  * The pop calls wait for an element following the WaitPolicy of the queue
+  * (BLOCK by default, see set_wait_policy).
   * This class is used internally by the QueueScheduler
   */
 template <typename T>
 class QueueThread
 {
 public:
+    typedef std::list<T, detail::RecyclingAllocator<T>> List;  // Content of the queue
+
     QueueThread(size_t maxSize = UNLIMITED);
     QueueThread(const QueueThread&) = delete;
     QueueThread& operator=(const QueueThread&) = delete;
@@ -34,31 +125,85 @@ public:
     void push_back(const T& elem);
     void push_back(T&& elem);
 
+    /** Push all the elements, in order, locking the queue once (or once per
+      * wait if the queue is full). The elements are moved and elems is cleared
+      */
+    void push_batch(std::vector<T>& elems);
+
     T pop_front();
 
+    /** Same as pop_front but wait at most for the given duration. Return false
+      * if the queue is still empty (elem is unchanged)
+      */
+    template <class Rep, class Period>
+    bool pop_for(T& elem, const std::chrono::duration<Rep, Period>& timeout);
+
+    /** Same as pop_front but never wait. Return false if the queue is empty
+      * (elem is unchanged)
+      */
+    bool try_pop(T& elem);
+
+    /** Block while the queue is empty, then append all the available elements
+      * (at most maxElems) to elems, locking the queue once. Return the number
+      * of elements popped
+      */
+    size_t pop_batch(std::vector<T>& elems, size_t maxElems);
+
+    /** Pop the element chosen by select instead of the first one. select is
+      * called with the queue content (const List&) and returns the
+      * iterator of the element to pop, or end() to keep waiting (called again
+      * after each push). Block until an element is chosen.
+      * WARNING: A push only wakes up one waiting call, so should only be used
+      * by a single thread
+      */
+    template <class Select>
+    T pop_select(Select select);
+
+    /** Same as pop_select but wait at most until the deadline. Return false if
+      * no element has been chosen in time (elem is unchanged)
+      */
+    template <class Select, class Clock, class Duration>
+    bool pop_select_until(T& elem, Select select, const std::chrono::time_point<Clock, Duration>& deadline);
+
+    /** Number of elements currently in the queue
+      */
+    size_t size();
+
+    /** How the pop calls wait for an element (see WaitPolicy)
+      * WARNING: Not thread safe. Should be called while no pop call is waiting
+      */
+    void set_wait_policy(const WaitPolicy& policy);
+
     // WARNING: Not thread safe. Just a convinience method. Be also careful
     // to not access the returned reference after QueueThread is destructed
-    const std::list<T>& get_data();
+    const List& get_data();
+
+    static constexpr size_t MAX_FREE_NODES = 64;  // Memory of the popped nodes kept for the next pushes
 
 private:
     bool is_not_full();  // Used by the condition variable
 
     std::mutex _mutexQueue;  // Prevent concurent calls to the queue (access or update)
-    std::condition_variable _cvEmpty;  // Lock the pop calls when one of the queue is empty
+    WaitPoint _waitEmpty;  // Lock the pop calls when one of the queue is empty
     std::condition_variable _cvFull;  // Lock the push calls when one of the queue is full
 
     size_t _maxSize;  // Max size of the queue
 
-    std::list<T> _queue;
+    detail::NodeCache _freeNodes;  // Declared before _queue, which releases its nodes into it
+    List _queue;
 };
 
+template <typename T>
+constexpr size_t QueueThread<T>::MAX_FREE_NODES;
+
 template <typename T>
 QueueThread<T>::QueueThread(size_t maxSize) :
     _mutexQueue(),
-    _cvEmpty(),
+    _waitEmpty(),
     _cvFull(),
     _maxSize(maxSize),
-    _queue()
+    _freeNodes(MAX_FREE_NODES),
+    _queue(detail::RecyclingAllocator<T>(&_freeNodes))
 {
 }
 
@@ -71,7 +216,7 @@ void QueueThread<T>::push_back(const T& elem)
 
     _queue.push_back(elem);
 
-    _cvEmpty.notify_one();  // Eventually unlock pop_front
+    _waitEmpty.notify_one();  // Eventually unlock pop_front
 }
 
 
@@ -83,7 +228,28 @@ void QueueThread<T>::push_back(T&& elem)
 
     _queue.push_back(std::move(elem));
 
-    _cvEmpty.notify_one();
+    _waitEmpty.notify_one();
+}
+
+
+template <typename T>
+void QueueThread<T>::push_batch(std::vector<T>& elems)
+{
+    auto elem = elems.begin();
+    while (elem != elems.end())
+    {
+        std::unique_lock<std::mutex> guard(_mutexQueue);
+        _cvFull.wait(guard, std::bind(&QueueThread<T>::is_not_full, this));
+
+        while (elem != elems.end() && is_not_full())
+        {
+            _queue.push_back(std::move(*elem));
+            ++elem;
+        }
+
+        _waitEmpty.notify_all();
+    }
+    elems.clear();
 }
 
 
@@ -91,7 +257,7 @@ template <typename T>
 T QueueThread<T>::pop_front()
 {
     std::unique_lock<std::mutex> guard(_mutexQueue);
-    _cvEmpty.wait(guard, [this]{ return this->_queue.size() > 0; });  // Wait for the queue to be filled
+    _waitEmpty.wait(guard, [this]{ return this->_queue.size() > 0; });  // Wait for the queue to be filled
 
     T elem = std::move(_queue.front());  // If we are here, we are sure that at least one element has been pushed (TODO: Is the move call safe ?)
     _queue.pop_front();
@@ -103,7 +269,117 @@ T QueueThread<T>::pop_front()
 
 
 template <typename T>
-const std::list<T>& QueueThread<T>::get_data()
+template <class Rep, class Period>
+bool QueueThread<T>::pop_for(T& elem, const std::chrono::duration<Rep, Period>& timeout)
+{
+    std::unique_lock<std::mutex> guard(_mutexQueue);
+    if (!_waitEmpty.wait_until(guard, std::chrono::steady_clock::now() + timeout, [this]{ return this->_queue.size() > 0; }))
+    {
+        return false;
+    }
+
+    elem = std::move(_queue.front());
+    _queue.pop_front();
+
+    _cvFull.notify_one();
+
+    return true;
+}
+
+
+template <typename T>
+bool QueueThread<T>::try_pop(T& elem)
+{
+    std::lock_guard<std::mutex> guard(_mutexQueue);
+    if (_queue.empty())
+    {
+        return false;
+    }
+
+    elem = std::move(_queue.front());
+    _queue.pop_front();
+
+    _cvFull.notify_one();
+
+    return true;
+}
+
+
+template <typename T>
+size_t QueueThread<T>::pop_batch(std::vector<T>& elems, size_t maxElems)
+{
+    std::unique_lock<std::mutex> guard(_mutexQueue);
+    _waitEmpty.wait(guard, [this]{ return this->_queue.size() > 0; });
+
+    size_t nbPopped = 0;
+    while (nbPopped < maxElems && !_queue.empty())
+    {
+        elems.push_back(std::move(_queue.front()));
+        _queue.pop_front();
+        ++nbPopped;
+    }
+
+    _cvFull.notify_all();  // Several pushes can be unlocked
+
+    return nbPopped;
+}
+
+
+template <typename T>
+template <class Select>
+T QueueThread<T>::pop_select(Select select)
+{
+    std::unique_lock<std::mutex> guard(_mutexQueue);
+    typename List::const_iterator node;
+    _waitEmpty.wait(guard, [this, &select, &node]{ node = select(static_cast<const List&>(this->_queue)); return node != this->_queue.cend(); });
+
+    T elem = std::move(*_queue.erase(node, node));  // Non const iterator on the same node
+    _queue.erase(node);
+
+    _cvFull.notify_one();
+
+    return elem;
+}
+
+
+template <typename T>
+template <class Select, class Clock, class Duration>
+bool QueueThread<T>::pop_select_until(T& elem, Select select, const std::chrono::time_point<Clock, Duration>& deadline)
+{
+    std::unique_lock<std::mutex> guard(_mutexQueue);
+    typename List::const_iterator node;
+    if (!_waitEmpty.wait_until(guard, deadline, [this, &select, &node]{ node = select(static_cast<const List&>(this->_queue)); return node != this->_queue.cend(); }))
+    {
+        return false;
+    }
+
+    elem = std::move(*_queue.erase(node, node));
+    _queue.erase(node);
+
+    _cvFull.notify_one();
+
+    return true;
+}
+
+
+template <typename T>
+size_t QueueThread<T>::size()
+{
+    std::lock_guard<std::mutex> guard(_mutexQueue);
+    return _queue.size();
+}
+
+
+template <typename T>
+void QueueThread<T>::set_wait_policy(const WaitPolicy& policy)
+{
+    std::lock_guard<std::mutex> guard(_mutexQueue);
+    _waitEmpty.set_policy(policy);
+}
+
+
+template <typename T>
+auto QueueThread<T>::get_data() -> const List&
 {
     return _queue;
 }
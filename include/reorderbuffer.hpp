@@ -0,0 +1,704 @@
+#ifndef JS_REORDERBUFFER_H
+#define JS_REORDERBUFFER_H
+
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <unordered_map>
+
+#include "queuethread.hpp"
+#include "schedulerstats.hpp"
+
+
+namespace job_scheduler
+{
+
+
+/** Order in which the completed elements are released
+  */
+enum class OrderingMode
+{
+    GLOBAL,  // In the order of the sequence numbers
+    KEYED,  // In the order of the sequence numbers among the slots of the same key (the keys don't wait for each other)
+    UNORDERED  // In the order of completion
+};
+
+
+// Key of a slot which is released only after all the previous slots (whatever
+// the ordering mode)
+constexpr size_t BARRIER_KEY = static_cast<size_t>(-1);
+
+
+/** Thread safe buffer which release the elements in the order of their
+  * sequence number, whatever the order in which they are completed.
+  * A slot is reserved for each sequence number (reserve), filled by any thread
+  * (set) and the elements are popped as soon as all the previous slots have
+  * been popped (pop_front).
+  * The slots are preallocated and indexed by sequence modulo the capacity. The
+  * reserve call is blocking if the maxSize parameter has been set and maxSize
+  * slots are already reserved and not popped yet (reorder window measured from
+  * the oldest unpopped sequence). If UNLIMITED, the buffer grows when needed.
+  * As for QueueThread, the reserve call and the pop call should each be done
+  * by a single thread.
+  * With the KEYED and UNORDERED ordering modes, a completed element does not
+  * wait for the previous slots (of the other keys), so a slow element only
+  * blocks the ones of its own key. The reorder window is still measured from
+  * the oldest unpopped sequence.
+  * A slot can also be dropped (set_dropped): it is completed without element
+  * and skipped by the pop calls (except pop_front(dropped)), so the next
+  * slots don't wait for it.
+  */
+template <typename T>
+class ReorderBuffer
+{
+public:
+    ReorderBuffer(size_t maxSize = UNLIMITED);
+    ReorderBuffer(const ReorderBuffer&) = delete;
+    ReorderBuffer& operator=(const ReorderBuffer&) = delete;
+    ~ReorderBuffer() = default;
+
+    /** Return the next sequence number. Block while the buffer is full
+      * The key is only used with the KEYED ordering mode (except BARRIER_KEY)
+      */
+    size_t reserve(size_t key = 0);
+
+    /** WARNING: Should be called while no slot is reserved
+      */
+    void set_ordering(OrderingMode mode);
+    OrderingMode ordering();
+
+    /** Change the maximum distance between the oldest unpopped sequence and
+      * the next reserved one. Can be called while the buffer is used
+      */
+    void set_max_size(size_t maxSize);
+    size_t max_size();
+
+    /** Number of sequences which can be reserved without blocking (UNLIMITED
+      * if the buffer has no maximum size)
+      */
+    size_t nb_free();
+
+    /** Fill the slot of the given sequence number (previously reserved)
+      */
+    void set(size_t sequence, T&& elem);
+
+    /** The exception will be rethrown by pop_front when the slot is reached
+      */
+    void set_exception(size_t sequence, std::exception_ptr error);
+
+    /** Complete the slot without element. It is skipped when reached
+      */
+    void set_dropped(size_t sequence);
+
+    /** Block while the next slot is not filled. If sequence is given, it is
+      * set to the sequence number of the popped slot (which is not the order
+      * of the pops with the KEYED and UNORDERED modes)
+      */
+    T pop_front(size_t* sequence = nullptr);
+
+    /** Same as pop_front but the dropped slots are also returned (T{} with
+      * dropped set to true)
+      */
+    T pop_front(bool& dropped, size_t* sequence = nullptr);
+
+    /** Same as pop_front but wait at most for the given duration. Return false
+      * if the next slot is still not filled (elem is unchanged)
+      */
+    template <class Rep, class Period>
+    bool pop_front_for(T& elem, const std::chrono::duration<Rep, Period>& timeout, size_t* sequence = nullptr);
+
+    /** Same as pop_front but never wait
+      */
+    bool try_pop_front(T& elem);
+
+    /** Block while the next slot is not filled, then append all the
+      * releasable elements (at most maxElems) to elems, locking the buffer
+      * once. Stop before a slot with an exception, which is rethrown if it is
+      * the first one. If sequences is given, the sequence number of each
+      * popped element is appended to it. Return the number of elements popped
+      */
+    size_t pop_batch(std::vector<T>& elems, size_t maxElems, std::vector<size_t>* sequences = nullptr);
+
+    /** Number of completed elements currently waiting for a previous slot
+      */
+    size_t out_of_order();
+
+    /** Maximum of out_of_order since the creation
+      */
+    size_t peak_out_of_order();
+
+    /** Number of dropped slots popped (skipped or returned) since the creation
+      */
+    size_t nb_dropped();
+
+    /** Number of reserve calls which had to wait because the buffer was full
+      * and total time spent waiting
+      */
+    size_t nb_full_stalls();
+    std::chrono::nanoseconds full_stalls_duration();
+
+    /** Record the time between the completion and the pop of each slot in
+      * the given histogram (only if JS_ENABLE_STATS is defined)
+      */
+    void set_wait_histogram(LatencyHistogram* histogram);
+
+    /** How the pop calls wait for the next slot (see WaitPolicy)
+      * WARNING: Not thread safe. Should be called while no pop call is waiting
+      */
+    void set_wait_policy(const WaitPolicy& policy);
+
+private:
+    struct Slot
+    {
+        T elem;
+        std::exception_ptr error;
+        bool ready;
+        bool dropped;
+        bool popped;  // Only used if not GLOBAL (the slots are not popped in order)
+        size_t key;
+        std::chrono::steady_clock::time_point completed;  // Only set if JS_ENABLE_STATS is defined (same layout either way)
+    };
+
+    Slot& slot(size_t sequence);
+
+    // Lock has to be acquired
+    bool is_front_ready();  // The next slot to pop is filled
+    size_t front_sequence();  // Next slot to pop (if ready)
+    T take_front(std::exception_ptr& error, bool& dropped, size_t& sequence);  // Pop the next slot (has to be ready)
+    void complete(size_t sequence);  // Mark the slot ready. Lock has to be acquired
+    void grow();  // Double the capacity. Lock has to be acquired
+
+    // Only used if not GLOBAL. Lock has to be acquired
+    bool is_releasable(size_t sequence);
+    void release(size_t sequence);  // Add the slot to the releasable ones
+    size_t pop_releasable();  // Remove the next slot to pop and update the keys and the head
+
+    std::mutex _mutexBuffer;
+    WaitPoint _waitReady;  // Lock the pop calls while the head slot is not filled
+    std::condition_variable _cvFull;  // Lock the reserve calls when the buffer is full
+
+    size_t _maxSize;
+    OrderingMode _ordering;
+
+    std::vector<Slot> _slots;  // Size is always a power of 2
+    size_t _head;  // Next sequence to pop
+    size_t _firstPending;  // First sequence not completed yet (>= _head)
+    size_t _tail;  // Next sequence to reserve
+    size_t _nbReady;  // Number of completed slots not popped yet
+
+    // Only used if not GLOBAL
+    std::deque<size_t> _releasable;  // Completed slots which can be popped, in the order they became releasable
+    std::unordered_map<size_t, std::deque<size_t>> _keySequences;  // Unpopped slots of each key (KEYED only)
+
+    size_t _peakOutOfOrder;
+    size_t _nbDropped;
+    size_t _nbFullStalls;
+    std::chrono::nanoseconds _fullStallsDuration;
+
+    LatencyHistogram* _waitHistogram;
+};
+
+
+template <typename T>
+ReorderBuffer<T>::ReorderBuffer(size_t maxSize) :
+    _mutexBuffer(),
+    _waitReady(),
+    _cvFull(),
+    _maxSize(maxSize),
+    _ordering(OrderingMode::GLOBAL),
+    _slots(),
+    _head(0),
+    _firstPending(0),
+    _tail(0),
+    _nbReady(0),
+    _releasable(),
+    _keySequences(),
+    _peakOutOfOrder(0),
+    _nbDropped(0),
+    _nbFullStalls(0),
+    _fullStallsDuration(0),
+    _waitHistogram(nullptr)
+{
+    size_t capacity = 1;
+    while (capacity < maxSize)  // Is at least 1 even if UNLIMITED
+    {
+        capacity *= 2;
+    }
+    _slots.resize(capacity);
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::reserve(size_t key)
+{
+    std::unique_lock<std::mutex> guard(_mutexBuffer);
+    auto isNotFull = [this]{ return this->_maxSize == UNLIMITED || this->_tail - this->_head < this->_maxSize; };
+    if (!isNotFull())
+    {
+        ++_nbFullStalls;
+        auto start = std::chrono::steady_clock::now();
+        _cvFull.wait(guard, isNotFull);
+        _fullStallsDuration += std::chrono::steady_clock::now() - start;
+    }
+    if (_tail - _head == _slots.size())
+    {
+        grow();
+    }
+
+    Slot& newSlot = slot(_tail);
+    newSlot.ready = false;
+    newSlot.dropped = false;
+    newSlot.popped = false;
+    newSlot.key = key;
+    if (_ordering == OrderingMode::KEYED && key != BARRIER_KEY)
+    {
+        _keySequences[key].push_back(_tail);
+    }
+    return _tail++;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::set_ordering(OrderingMode mode)
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    _ordering = mode;
+}
+
+
+template <typename T>
+OrderingMode ReorderBuffer<T>::ordering()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    return _ordering;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::set_max_size(size_t maxSize)
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    _maxSize = maxSize;
+    _cvFull.notify_all();
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::max_size()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    return _maxSize;
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::nb_free()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    if (_maxSize == UNLIMITED)
+    {
+        return UNLIMITED;
+    }
+    return _tail - _head < _maxSize ? _maxSize - (_tail - _head) : 0;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::set(size_t sequence, T&& elem)
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    slot(sequence).elem = std::move(elem);
+    complete(sequence);
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::set_exception(size_t sequence, std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    slot(sequence).error = error;
+    complete(sequence);
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::set_dropped(size_t sequence)
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    slot(sequence).dropped = true;
+    complete(sequence);
+}
+
+
+template <typename T>
+T ReorderBuffer<T>::pop_front(size_t* sequence)
+{
+    T elem;
+    bool dropped = true;
+    while (dropped)
+    {
+        elem = pop_front(dropped, sequence);
+    }
+    return elem;
+}
+
+
+template <typename T>
+T ReorderBuffer<T>::pop_front(bool& dropped, size_t* sequence)
+{
+    std::unique_lock<std::mutex> guard(_mutexBuffer);
+    _waitReady.wait(guard, [this]{ return this->is_front_ready(); });
+
+    std::exception_ptr error;
+    size_t poppedSequence = 0;
+    T elem = take_front(error, dropped, poppedSequence);
+    if (sequence)
+    {
+        *sequence = poppedSequence;
+    }
+
+    _cvFull.notify_one();  // Eventually unlock reserve
+    guard.unlock();
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    return elem;
+}
+
+
+template <typename T>
+template <class Rep, class Period>
+bool ReorderBuffer<T>::pop_front_for(T& elem, const std::chrono::duration<Rep, Period>& timeout, size_t* sequence)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> guard(_mutexBuffer);
+
+    std::exception_ptr error;
+    T popped;
+    size_t poppedSequence = 0;
+    bool dropped = true;
+    while (dropped)  // Skip the dropped slots
+    {
+        if (!_waitReady.wait_until(guard, deadline, [this]{ return this->is_front_ready(); }))
+        {
+            return false;
+        }
+        popped = take_front(error, dropped, poppedSequence);
+        _cvFull.notify_one();
+    }
+    guard.unlock();
+
+    if (sequence)
+    {
+        *sequence = poppedSequence;
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    elem = std::move(popped);
+    return true;
+}
+
+
+template <typename T>
+bool ReorderBuffer<T>::try_pop_front(T& elem)
+{
+    return pop_front_for(elem, std::chrono::nanoseconds::zero());
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::pop_batch(std::vector<T>& elems, size_t maxElems, std::vector<size_t>* sequences)
+{
+    std::unique_lock<std::mutex> guard(_mutexBuffer);
+
+    size_t nbPopped = 0;
+    std::exception_ptr error;
+    do  // Wait again if only dropped slots were releasable
+    {
+        _waitReady.wait(guard, [this]{ return this->is_front_ready(); });
+        while (nbPopped < maxElems && is_front_ready())
+        {
+            if (nbPopped > 0 && slot(front_sequence()).error)
+            {
+                break;  // Rethrown by the next pop
+            }
+            bool dropped = false;
+            size_t sequence = 0;
+            T elem = take_front(error, dropped, sequence);
+            if (error)
+            {
+                break;
+            }
+            if (!dropped)
+            {
+                elems.push_back(std::move(elem));
+                if (sequences)
+                {
+                    sequences->push_back(sequence);
+                }
+                ++nbPopped;
+            }
+        }
+        _cvFull.notify_one();
+    } while (nbPopped == 0 && maxElems > 0 && !error);
+    guard.unlock();
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    return nbPopped;
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::out_of_order()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    if (_ordering != OrderingMode::GLOBAL)
+    {
+        return _nbReady - _releasable.size();
+    }
+    return _nbReady - (_firstPending - _head);
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::peak_out_of_order()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    return _peakOutOfOrder;
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::nb_dropped()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    return _nbDropped;
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::nb_full_stalls()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    return _nbFullStalls;
+}
+
+
+template <typename T>
+std::chrono::nanoseconds ReorderBuffer<T>::full_stalls_duration()
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    return _fullStallsDuration;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::set_wait_histogram(LatencyHistogram* histogram)
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    _waitHistogram = histogram;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::set_wait_policy(const WaitPolicy& policy)
+{
+    std::lock_guard<std::mutex> guard(_mutexBuffer);
+    _waitReady.set_policy(policy);
+}
+
+
+template <typename T>
+auto ReorderBuffer<T>::slot(size_t sequence) -> Slot&
+{
+    return _slots[sequence & (_slots.size() - 1)];
+}
+
+
+template <typename T>
+bool ReorderBuffer<T>::is_front_ready()
+{
+    if (_ordering == OrderingMode::GLOBAL)
+    {
+        return _head != _tail && slot(_head).ready;
+    }
+    return !_releasable.empty();
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::front_sequence()
+{
+    return _ordering == OrderingMode::GLOBAL ? _head : _releasable.front();
+}
+
+
+template <typename T>
+T ReorderBuffer<T>::take_front(std::exception_ptr& error, bool& dropped, size_t& sequence)
+{
+    sequence = _head;
+    if (_ordering == OrderingMode::GLOBAL)
+    {
+        ++_head;
+    }
+    else
+    {
+        sequence = pop_releasable();
+    }
+
+    Slot& poppedSlot = slot(sequence);
+    T elem = std::move(poppedSlot.elem);
+    error = poppedSlot.error;
+    dropped = poppedSlot.dropped;
+    poppedSlot.elem = T{};
+    poppedSlot.error = nullptr;
+    poppedSlot.ready = false;
+    poppedSlot.dropped = false;
+    if (dropped)
+    {
+        ++_nbDropped;
+    }
+    JS_STATS(
+        if (_waitHistogram)
+        {
+            _waitHistogram->record(std::chrono::steady_clock::now() - poppedSlot.completed);
+        }
+    )
+
+    --_nbReady;
+    return elem;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::complete(size_t sequence)
+{
+    slot(sequence).ready = true;
+    JS_STATS(slot(sequence).completed = std::chrono::steady_clock::now();)
+    ++_nbReady;
+
+    if (_ordering != OrderingMode::GLOBAL)
+    {
+        if (is_releasable(sequence))
+        {
+            release(sequence);
+        }
+        size_t outOfOrder = _nbReady - _releasable.size();
+        if (outOfOrder > _peakOutOfOrder)
+        {
+            _peakOutOfOrder = outOfOrder;
+        }
+        return;
+    }
+
+    // The contiguous completed slots are not out of order
+    while (_firstPending != _tail && slot(_firstPending).ready)
+    {
+        ++_firstPending;
+    }
+    size_t outOfOrder = _nbReady - (_firstPending - _head);
+    if (outOfOrder > _peakOutOfOrder)
+    {
+        _peakOutOfOrder = outOfOrder;
+    }
+
+    if (sequence == _head)
+    {
+        _waitReady.notify_one();  // Eventually unlock pop_front
+    }
+}
+
+
+template <typename T>
+bool ReorderBuffer<T>::is_releasable(size_t sequence)
+{
+    Slot& completedSlot = slot(sequence);
+    if (!completedSlot.ready)
+    {
+        return false;
+    }
+    if (completedSlot.key == BARRIER_KEY)
+    {
+        return sequence == _head;  // All the previous slots have been popped
+    }
+    if (_ordering == OrderingMode::KEYED)
+    {
+        return _keySequences[completedSlot.key].front() == sequence;  // First unpopped of its key
+    }
+    return true;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::release(size_t sequence)
+{
+    _releasable.push_back(sequence);
+    _waitReady.notify_one();  // Eventually unlock pop_front
+}
+
+
+template <typename T>
+size_t ReorderBuffer<T>::pop_releasable()
+{
+    size_t sequence = _releasable.front();
+    _releasable.pop_front();
+
+    Slot& poppedSlot = slot(sequence);
+    poppedSlot.popped = true;
+
+    // The next slot of the same key can now be released
+    if (_ordering == OrderingMode::KEYED && poppedSlot.key != BARRIER_KEY)
+    {
+        auto keySequences = _keySequences.find(poppedSlot.key);
+        keySequences->second.pop_front();
+        if (keySequences->second.empty())
+        {
+            _keySequences.erase(keySequences);  // Don't keep the keys which are not used anymore
+        }
+        else if (is_releasable(keySequences->second.front()))
+        {
+            release(keySequences->second.front());
+        }
+    }
+
+    // The window start at the oldest unpopped slot
+    bool headMoved = false;
+    while (_head != _tail && slot(_head).popped)
+    {
+        ++_head;
+        headMoved = true;
+    }
+    if (headMoved && _head != _tail && slot(_head).key == BARRIER_KEY && is_releasable(_head))
+    {
+        release(_head);
+    }
+    return sequence;
+}
+
+
+template <typename T>
+void ReorderBuffer<T>::grow()
+{
+    std::vector<Slot> newSlots(_slots.size() * 2);
+    for (size_t sequence = _head ; sequence != _tail ; ++sequence)
+    {
+        newSlots[sequence & (newSlots.size() - 1)] = std::move(slot(sequence));
+    }
+    _slots.swap(newSlots);
+}
+
+
+} // End namespace
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef JS_SCHEDULERSTATS_H
+#define JS_SCHEDULERSTATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+
+
+/** The statistics are only recorded if JS_ENABLE_STATS is defined (ex: with
+  * the cmake option of the same name). Otherwise the recording code and the
+  * statistics members of the QueueScheduler are compiled out (its stats()
+  * returns an empty SchedulerStats).
+  * WARNING: The QueueScheduler members depend on it, so it has to be defined
+  * the same way for all the compilation units sharing a QueueScheduler type.
+  * The layout of the other classes (ex: ReorderBuffer) does not depend on it.
+  */
+#ifdef JS_ENABLE_STATS
+#define JS_STATS(statement) statement
+#else
+#define JS_STATS(statement)
+#endif
+
+
+namespace job_scheduler
+{
+
+
+#ifdef JS_ENABLE_STATS
+constexpr bool STATS_ENABLED = true;
+#else
+constexpr bool STATS_ENABLED = false;
+#endif
+
+
+/** Thread safe histogram of durations, with one bucket per power of 2 (in
+  * nanoseconds). Can be recorded and read from any thread without lock.
+  */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t NB_BUCKETS = 48;  // Last bucket is ~39h
+
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+    ~LatencyHistogram() = default;
+
+    void record(std::chrono::nanoseconds duration);
+
+    uint64_t count() const;
+    std::chrono::nanoseconds total() const;
+    std::chrono::nanoseconds max() const;
+    std::chrono::nanoseconds mean() const;
+
+    /** Upper bound of the bucket containing the given percentile (in [0, 1]),
+      * bounded by the max
+      */
+    std::chrono::nanoseconds percentile(double p) const;
+
+    /** Number of durations in [2^i, 2^(i+1)) ns (bucket 0 also contains 0)
+      */
+    uint64_t bucket(size_t i) const;
+
+private:
+    std::atomic<uint64_t> _buckets[NB_BUCKETS];
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _totalNs;
+    std::atomic<uint64_t> _maxNs;
+};
+
+
+/** Current and peak value of a queue depth
+  */
+class DepthGauge
+{
+public:
+    DepthGauge() : _current(0), _peak(0) {}
+    DepthGauge(const DepthGauge&) = delete;
+    DepthGauge& operator=(const DepthGauge&) = delete;
+
+    void add(int64_t delta);
+
+    int64_t current() const { return _current.load(std::memory_order_relaxed); }
+    int64_t peak() const { return _peak.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> _current;
+    std::atomic<int64_t> _peak;
+};
+
+
+/** Statistics of a single worker
+  */
+struct WorkerStats
+{
+    LatencyHistogram service;  // Time spent in the worker call (per job, or per batch)
+    std::atomic<uint64_t> nbInputs{0};  // Number of inputs processed
+};
+
+
+/** Runtime metrics of a QueueScheduler. Every member can be read from any
+  * thread while the scheduler is running.
+  */
+class SchedulerStats
+{
+public:
+    SchedulerStats() = default;
+    SchedulerStats(const SchedulerStats&) = delete;
+    SchedulerStats& operator=(const SchedulerStats&) = delete;
+
+    LatencyHistogram feeder;  // Time spent in the feeder call to produce an input
+    LatencyHistogram inputWait;  // Time an input waits in the input queue
+    LatencyHistogram workerAcquire;  // Time the scheduler waits for an available worker
+    LatencyHistogram outputWait;  // Time an output waits between its completion and its pop (reorder)
+    LatencyHistogram pop;  // Time the pop calls are blocked
+
+    DepthGauge inputDepth;  // Number of inputs in the input queue
+    DepthGauge outputDepth;  // Number of reserved output slots (dispatched or waiting to be popped)
+
+    /** Statistics of the worker of the given index (creation order)
+      */
+    const WorkerStats& worker(size_t index) const;
+    size_t nb_workers() const;
+
+    /** Used by the scheduler when a new worker is created. The returned
+      * reference stay valid
+      */
+    WorkerStats& add_worker();
+
+    /** Human readable summary
+      */
+    void print(std::ostream& os) const;
+
+private:
+    mutable std::mutex _mutexWorkers;  // Protect the deque structure (not the stats)
+    std::deque<WorkerStats> _workers;
+};
+
+
+inline LatencyHistogram::LatencyHistogram() :
+    _count(0),
+    _totalNs(0),
+    _maxNs(0)
+{
+    for (std::atomic<uint64_t>& bucket : _buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+inline void LatencyHistogram::record(std::chrono::nanoseconds duration)
+{
+    uint64_t ns = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+
+    size_t index = 63 - __builtin_clzll(ns | 1);  // log2
+    if (index >= NB_BUCKETS)
+    {
+        index = NB_BUCKETS - 1;
+    }
+
+    _buckets[index].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _totalNs.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t previousMax = _maxNs.load(std::memory_order_relaxed);
+    while (ns > previousMax && !_maxNs.compare_exchange_weak(previousMax, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+inline uint64_t LatencyHistogram::count() const
+{
+    return _count.load(std::memory_order_relaxed);
+}
+
+
+inline std::chrono::nanoseconds LatencyHistogram::total() const
+{
+    return std::chrono::nanoseconds(_totalNs.load(std::memory_order_relaxed));
+}
+
+
+inline std::chrono::nanoseconds LatencyHistogram::max() const
+{
+    return std::chrono::nanoseconds(_maxNs.load(std::memory_order_relaxed));
+}
+
+
+inline std::chrono::nanoseconds LatencyHistogram::mean() const
+{
+    uint64_t nb = count();
+    return nb == 0 ? std::chrono::nanoseconds(0) : total() / static_cast<int64_t>(nb);
+}
+
+
+inline std::chrono::nanoseconds LatencyHistogram::percentile(double p) const
+{
+    uint64_t nb = count();
+    if (nb == 0)
+    {
+        return std::chrono::nanoseconds(0);
+    }
+
+    uint64_t rank = static_cast<uint64_t>(p * nb);
+    uint64_t accumulated = 0;
+    for (size_t i = 0 ; i < NB_BUCKETS ; ++i)
+    {
+        accumulated += bucket(i);
+        if (accumulated > rank)
+        {
+            return std::min(std::chrono::nanoseconds((uint64_t(1) << (i + 1)) - 1), max());
+        }
+    }
+    return max();
+}
+
+
+inline uint64_t LatencyHistogram::bucket(size_t i) const
+{
+    return _buckets[i].load(std::memory_order_relaxed);
+}
+
+
+inline void DepthGauge::add(int64_t delta)
+{
+    int64_t value = _current.fetch_add(delta, std::memory_order_relaxed) + delta;
+
+    int64_t previousPeak = _peak.load(std::memory_order_relaxed);
+    while (value > previousPeak && !_peak.compare_exchange_weak(previousPeak, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+inline const WorkerStats& SchedulerStats::worker(size_t index) const
+{
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    return _workers.at(index);
+}
+
+
+inline size_t SchedulerStats::nb_workers() const
+{
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    return _workers.size();
+}
+
+
+inline WorkerStats& SchedulerStats::add_worker()
+{
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    _workers.emplace_back();  // The deque keeps the references of the previous elements valid
+    return _workers.back();
+}
+
+
+inline void SchedulerStats::print(std::ostream& os) const
+{
+    auto printHistogram = [&os](const char* name, const LatencyHistogram& histogram) {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        os << name << ": count=" << histogram.count()
+           << " mean=" << duration_cast<microseconds>(histogram.mean()).count() << "us"
+           << " p50<" << duration_cast<microseconds>(histogram.percentile(0.5)).count() << "us"
+           << " p99<" << duration_cast<microseconds>(histogram.percentile(0.99)).count() << "us"
+           << " max=" << duration_cast<microseconds>(histogram.max()).count() << "us"
+           << std::endl;
+    };
+
+    if (!STATS_ENABLED)
+    {
+        os << "(statistics not recorded, JS_ENABLE_STATS is not defined)" << std::endl;
+    }
+    printHistogram("feeder", feeder);
+    printHistogram("input wait", inputWait);
+    printHistogram("worker acquire", workerAcquire);
+    printHistogram("output wait", outputWait);
+    printHistogram("pop", pop);
+    os << "input depth: peak=" << inputDepth.peak() << std::endl;
+    os << "output depth: peak=" << outputDepth.peak() << std::endl;
+
+    std::lock_guard<std::mutex> guard(_mutexWorkers);
+    for (size_t i = 0 ; i < _workers.size() ; ++i)
+    {
+        os << "worker " << i << ": inputs=" << _workers[i].nbInputs.load(std::memory_order_relaxed) << " ";
+        printHistogram("service", _workers[i].service);
+    }
+}
+
+
+} // End namespace
+
+#endif
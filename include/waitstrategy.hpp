@@ -0,0 +1,229 @@
+#ifndef JS_WAITSTRATEGY_H
+#define JS_WAITSTRATEGY_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+namespace job_scheduler
+{
+
+
+/** How a call waits for an element (see WaitPolicy)
+  */
+enum class WaitStrategy
+{
+    BLOCK,  // Sleep on a condition variable right away (no CPU used while waiting)
+    SPIN_THEN_BLOCK,  // Spin, then yield, then sleep (no sleep/wake up cost for the short waits)
+    BUSY_POLL  // Spin, then yield, never sleep (lowest latency, occupy a core while waiting)
+};
+
+
+/** Wait strategy of a queue, and its bounds. A spin is a cpu pause (a few
+  * tens of ns), a yield lets the other threads of the core run. The wake up
+  * of a sleeping thread costs a few tens of microseconds, so the spinning
+  * calls pay off when the element arrives within that time. BUSY_POLL is
+  * meant for threads which have a core to themselves (see PlacementPolicy):
+  * otherwise, they slow down the threads they are waiting for.
+  */
+struct WaitPolicy
+{
+    WaitPolicy(WaitStrategy strategy = WaitStrategy::BLOCK, size_t nbSpin = 1000, size_t nbYield = 50) :
+        strategy(strategy), nbSpin(nbSpin), nbYield(nbYield)
+    {}
+
+    WaitStrategy strategy;
+    size_t nbSpin;  // Checks separated by a cpu pause, before yielding
+    size_t nbYield;  // Then checks separated by a yield, before sleeping (SPIN_THEN_BLOCK only)
+};
+
+
+namespace detail
+{
+
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/** Pause before the next check of a waiting call (iteration starting at 0).
+  * Return false once the call has to sleep
+  */
+inline bool spin_pause(const WaitPolicy& policy, size_t iteration)
+{
+    if (policy.strategy == WaitStrategy::BLOCK)
+    {
+        return false;
+    }
+    if (iteration < policy.nbSpin)
+    {
+        cpu_relax();
+        return true;
+    }
+    if (policy.strategy == WaitStrategy::BUSY_POLL || iteration < policy.nbSpin + policy.nbYield)
+    {
+        std::this_thread::yield();
+        return true;
+    }
+    return false;
+}
+
+} // End namespace detail
+
+
+/** Condition variable following a WaitPolicy, for a condition protected by a
+  * mutex. Before sleeping, the spinning calls poll a counter bumped by each
+  * notify without the lock, and only lock to check the condition once it
+  * has changed. The notify calls only wake up the condition variable if a
+  * call is sleeping on it.
+  */
+class WaitPoint
+{
+public:
+    WaitPoint();
+    WaitPoint(const WaitPoint&) = delete;
+    WaitPoint& operator=(const WaitPoint&) = delete;
+
+    /** WARNING: Not thread safe. Should be called while no call is waiting
+      */
+    void set_policy(const WaitPolicy& policy);
+    const WaitPolicy& policy() const;
+
+    /** Same as std::condition_variable wait and wait_until: the lock has to
+      * be acquired by guard, and is acquired when returning
+      */
+    template <class Ready>
+    void wait(std::unique_lock<std::mutex>& guard, Ready ready);
+    template <class Clock, class Duration, class Ready>
+    bool wait_until(std::unique_lock<std::mutex>& guard, const std::chrono::time_point<Clock, Duration>& deadline, Ready ready);
+
+    // The lock has to be acquired
+    void notify_one();
+    void notify_all();
+
+private:
+    /** Spin until ready (return true) or until the policy requires to sleep or
+      * the wait has expired (return false). The lock is acquired when returning
+      */
+    template <class Ready, class Expired>
+    bool spin(std::unique_lock<std::mutex>& guard, Ready& ready, Expired expired);
+
+    std::condition_variable _cv;
+    WaitPolicy _policy;
+    std::atomic<size_t> _nbNotified;  // Polled by the spinning calls
+    size_t _nbSleeping;  // Protected by the lock
+};
+
+
+inline WaitPoint::WaitPoint() :
+    _cv(),
+    _policy(),
+    _nbNotified(0),
+    _nbSleeping(0)
+{
+}
+
+
+inline void WaitPoint::set_policy(const WaitPolicy& policy)
+{
+    _policy = policy;
+}
+
+
+inline const WaitPolicy& WaitPoint::policy() const
+{
+    return _policy;
+}
+
+
+template <class Ready>
+void WaitPoint::wait(std::unique_lock<std::mutex>& guard, Ready ready)
+{
+    if (spin(guard, ready, []{ return false; }))
+    {
+        return;
+    }
+    ++_nbSleeping;
+    _cv.wait(guard, ready);
+    --_nbSleeping;
+}
+
+
+template <class Clock, class Duration, class Ready>
+bool WaitPoint::wait_until(std::unique_lock<std::mutex>& guard, const std::chrono::time_point<Clock, Duration>& deadline, Ready ready)
+{
+    if (spin(guard, ready, [&deadline]{ return Clock::now() >= deadline; }))
+    {
+        return true;
+    }
+    ++_nbSleeping;
+    bool isReady = _cv.wait_until(guard, deadline, ready);
+    --_nbSleeping;
+    return isReady;
+}
+
+
+inline void WaitPoint::notify_one()
+{
+    _nbNotified.fetch_add(1, std::memory_order_release);
+    if (_nbSleeping > 0)
+    {
+        _cv.notify_one();
+    }
+}
+
+
+inline void WaitPoint::notify_all()
+{
+    _nbNotified.fetch_add(1, std::memory_order_release);
+    if (_nbSleeping > 0)
+    {
+        _cv.notify_all();
+    }
+}
+
+
+template <class Ready, class Expired>
+bool WaitPoint::spin(std::unique_lock<std::mutex>& guard, Ready& ready, Expired expired)
+{
+    if (ready())
+    {
+        return true;
+    }
+    if (_policy.strategy == WaitStrategy::BLOCK)
+    {
+        return false;
+    }
+
+    size_t nbNotified = _nbNotified.load(std::memory_order_relaxed);
+    guard.unlock();
+    for (size_t i = 0 ; detail::spin_pause(_policy, i) && !expired() ; ++i)
+    {
+        if (_nbNotified.load(std::memory_order_acquire) != nbNotified)  // Only lock when the condition may have changed
+        {
+            guard.lock();
+            if (ready())
+            {
+                return true;
+            }
+            nbNotified = _nbNotified.load(std::memory_order_relaxed);
+            guard.unlock();
+        }
+    }
+    guard.lock();
+    return false;
+}
+
+
+} // End namespace
+
+#endif
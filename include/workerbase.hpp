@@ -3,6 +3,7 @@
 
 
 #include <memory>
+#include <vector>
 
 
 namespace job_scheduler
@@ -23,6 +24,22 @@ public:
 
     virtual std::unique_ptr<Output> operator() (const Input& input) = 0;
 
+    /** Process several inputs in a single call (ex: GPU micro-batch) and
+      * return one output per input, in the same order.
+      * Only called if the scheduler batching is enabled. By default, each
+      * input is processed independently.
+      */
+    virtual std::vector<std::unique_ptr<Output>> process_batch(const std::vector<const Input*>& inputs)
+    {
+        std::vector<std::unique_ptr<Output>> outputs;
+        outputs.reserve(inputs.size());
+        for (const Input* input : inputs)
+        {
+            outputs.push_back((*this)(*input));
+        }
+        return outputs;
+    }
+
 protected:
     int m_worker_id;
 };
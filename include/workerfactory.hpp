@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <functional>
+#include <type_traits>
 
 
 namespace job_scheduler
@@ -10,7 +11,10 @@ namespace job_scheduler
 
 /** Wrapper arround the workers creation
   * The WorkerFactory just forward the given arguments when creating the workers.
-  * In addition, the worker id is given as first parameter.
+  * In addition, the worker id is given as first parameter (if the Worker can be
+  * constructed with it, otherwise only the arguments are given).
+  * Each worker is constructed with its own copy of the arguments, given as
+  * rvalues (or as lvalues if the constructor takes non const references).
   */
 template <class Worker>
 class WorkerFactory
@@ -29,7 +33,20 @@ public:
       */
     std::unique_ptr<Worker> buildNew(int workerId) const;
 private:
-    std::function<std::unique_ptr<Worker>(int)> _delayedBuilder;  // Used as proxy to pack the variadic arguments
+    template <typename... Args>
+    static std::unique_ptr<Worker> make_worker(int workerId, Args... args);  // args are the copies of the current worker
+
+    // Tags: with the worker id, arguments moved
+    template <typename... Args>
+    static std::unique_ptr<Worker> construct(std::true_type, std::true_type, int workerId, Args&... args);  // Worker(workerId, std::move(args)...)
+    template <typename... Args>
+    static std::unique_ptr<Worker> construct(std::true_type, std::false_type, int workerId, Args&... args);  // Worker(workerId, args...)
+    template <typename... Args>
+    static std::unique_ptr<Worker> construct(std::false_type, std::true_type, int workerId, Args&... args);  // Worker(std::move(args)...)
+    template <typename... Args>
+    static std::unique_ptr<Worker> construct(std::false_type, std::false_type, int workerId, Args&... args);  // Worker(args...)
+
+    std::function<std::unique_ptr<Worker>(int)> _delayedBuilder;  // Used as proxy to pack the variadic arguments (only called when a worker is created)
 };
 
 
@@ -41,18 +58,58 @@ WorkerFactory<Worker>::WorkerFactory(Args... args) :
     _delayedBuilder()
 {
     // Save the args for later use
-    auto make_new = [](int workerId, Args... args)  // Add 'mutable' if Args are not const ref ?
+    _delayedBuilder = [args...](int workerId)
     {
-        return std::unique_ptr<Worker>(new Worker(workerId, std::forward<Args>(args)...));
+        return make_worker(workerId, args...);  // Copy the arguments for each worker
     };
-    _delayedBuilder = std::bind(make_new, std::placeholders::_1, args...);  // Need to bind the function in order to save the arguments
+}
+
+template <class Worker>
+template <typename... Args>
+std::unique_ptr<Worker> WorkerFactory<Worker>::make_worker(int workerId, Args... args)
+{
+    using WithId = std::integral_constant<bool,
+        std::is_constructible<Worker, int, Args&&...>::value || std::is_constructible<Worker, int, Args&...>::value
+    >;
+    using Moved = std::integral_constant<bool,
+        WithId::value ? std::is_constructible<Worker, int, Args&&...>::value : std::is_constructible<Worker, Args&&...>::value
+    >;
+    return construct(WithId{}, Moved{}, workerId, args...);
+}
+
+template <class Worker>
+template <typename... Args>
+std::unique_ptr<Worker> WorkerFactory<Worker>::construct(std::true_type, std::true_type, int workerId, Args&... args)
+{
+    return std::unique_ptr<Worker>(new Worker(workerId, std::move(args)...));
+}
+
+template <class Worker>
+template <typename... Args>
+std::unique_ptr<Worker> WorkerFactory<Worker>::construct(std::true_type, std::false_type, int workerId, Args&... args)
+{
+    return std::unique_ptr<Worker>(new Worker(workerId, args...));
+}
+
+template <class Worker>
+template <typename... Args>
+std::unique_ptr<Worker> WorkerFactory<Worker>::construct(std::false_type, std::true_type, int, Args&... args)
+{
+    return std::unique_ptr<Worker>(new Worker(std::move(args)...));
+}
+
+template <class Worker>
+template <typename... Args>
+std::unique_ptr<Worker> WorkerFactory<Worker>::construct(std::false_type, std::false_type, int, Args&... args)
+{
+    return std::unique_ptr<Worker>(new Worker(args...));
 }
 
 template <class Worker>
 std::unique_ptr<Worker> WorkerFactory<Worker>::buildNew(int workerId) const
 {
     auto newWorker = _delayedBuilder(workerId);
-    return std::move(newWorker);
+    return newWorker;
 }
 
 
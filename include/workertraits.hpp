@@ -0,0 +1,168 @@
+#ifndef JS_WORKERTRAITS_H
+#define JS_WORKERTRAITS_H
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace job_scheduler
+{
+
+
+namespace detail
+{
+
+
+template <typename...>
+struct VoidType
+{
+    using type = void;
+};
+
+
+/** Input and output types deduced from the signature of operator() (valid is
+  * false if the signature is not supported)
+  */
+template <typename Call>
+struct CallTypes
+{
+    static constexpr bool valid = false;
+};
+
+template <class Worker, typename Input, typename Output>
+struct CallTypes<std::unique_ptr<Output> (Worker::*)(const Input&)>
+{
+    static constexpr bool valid = true;
+    using input_type = Input;
+    using output_type = Output;
+};
+
+template <class Worker, typename Input, typename Output>
+struct CallTypes<std::unique_ptr<Output> (Worker::*)(const Input&) const> : CallTypes<std::unique_ptr<Output> (Worker::*)(const Input&)>
+{
+};
+
+
+/** CallTypes of the Worker operator(). The address of an overloaded or
+  * template operator() cannot be taken, so nothing is deduced (valid is false)
+  */
+template <class Worker, typename = void>
+struct CallTypesOf
+{
+    static constexpr bool valid = false;
+};
+
+template <class Worker>
+struct CallTypesOf<Worker, typename VoidType<decltype(&Worker::operator())>::type> : CallTypes<decltype(&Worker::operator())>
+{
+};
+
+
+/** Use the input_type and output_type of the Worker if defined (ex: WorkerBase),
+  * deduce them from operator() otherwise
+  */
+template <class Worker, typename = void>
+struct WorkerTypes : CallTypesOf<Worker>
+{
+};
+
+template <class Worker>
+struct WorkerTypes<Worker, typename VoidType<typename Worker::input_type, typename Worker::output_type>::type>
+{
+    static constexpr bool valid = true;
+    using input_type = typename Worker::input_type;
+    using output_type = typename Worker::output_type;
+};
+
+
+template <class Worker, typename Input, typename Output, typename = void>
+struct IsCallable : std::false_type
+{
+};
+
+template <class Worker, typename Input, typename Output>
+struct IsCallable<Worker, Input, Output, typename VoidType<decltype(std::declval<Worker&>()(std::declval<const Input&>()))>::type> :
+    std::is_convertible<decltype(std::declval<Worker&>()(std::declval<const Input&>())), std::unique_ptr<Output>>
+{
+};
+
+
+template <class Worker, typename Input, typename = void>
+struct HasProcessBatch : std::false_type
+{
+};
+
+template <class Worker, typename Input>
+struct HasProcessBatch<Worker, Input, typename VoidType<decltype(std::declval<Worker&>().process_batch(std::declval<const std::vector<const Input*>&>()))>::type> : std::true_type
+{
+};
+
+
+} // End namespace detail
+
+
+/** Compile time description of a worker. Any class with a
+  * std::unique_ptr<Output> operator()(const Input&) can be used as worker
+  * (WorkerBase is not required). The batch method process_batch is optional.
+  * The calls are resolved at compile time (no virtual call unless the Worker
+  * inherit from WorkerBase, and none if it is declared final).
+  * If operator() is overloaded or a template, the types cannot be deduced: the
+  * Worker has to define input_type and output_type (or inherit from WorkerBase).
+  */
+template <class Worker>
+struct WorkerTraits
+{
+    static_assert(detail::WorkerTypes<Worker>::valid,
+        "Cannot deduce the input and output types of the Worker: define input_type and output_type "
+        "(or inherit from WorkerBase), or a single std::unique_ptr<Output> operator()(const Input&)");
+
+    using input_type = typename detail::WorkerTypes<Worker>::input_type;
+    using output_type = typename detail::WorkerTypes<Worker>::output_type;
+
+    static constexpr bool is_callable = detail::IsCallable<Worker, input_type, output_type>::value;
+    static constexpr bool has_batch = detail::HasProcessBatch<Worker, input_type>::value;
+
+    static std::unique_ptr<output_type> process(Worker& worker, const input_type& input)
+    {
+        return worker(input);
+    }
+
+    /** Call the worker process_batch if defined, otherwise process each input
+      * independently
+      */
+    static std::vector<std::unique_ptr<output_type>> process_batch(Worker& worker, const std::vector<const input_type*>& inputs)
+    {
+        return process_batch(worker, inputs, std::integral_constant<bool, has_batch>{});
+    }
+
+private:
+    static std::vector<std::unique_ptr<output_type>> process_batch(Worker& worker, const std::vector<const input_type*>& inputs, std::true_type)
+    {
+        return worker.process_batch(inputs);
+    }
+
+    static std::vector<std::unique_ptr<output_type>> process_batch(Worker& worker, const std::vector<const input_type*>& inputs, std::false_type)
+    {
+        std::vector<std::unique_ptr<output_type>> outputs;
+        outputs.reserve(inputs.size());
+        for (const input_type* input : inputs)
+        {
+            outputs.push_back(worker(*input));
+        }
+        return outputs;
+    }
+};
+
+
+template <class Worker>
+constexpr bool WorkerTraits<Worker>::is_callable;
+
+template <class Worker>
+constexpr bool WorkerTraits<Worker>::has_batch;
+
+
+} // End namespace
+
+#endif
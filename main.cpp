@@ -1,11 +1,18 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <thread>
 #include <future>
 
+#include <unistd.h>
+
 // TODO: Should encapsulate includes into include/job_scheduler/... (and have a include/job_scheduler.hpp)
 #include <job_scheduler.hpp>
+#include <mappedfeeder.hpp>  // POSIX only, not part of job_scheduler.hpp
+#include <orderedsink.hpp>  // POSIX only, not part of job_scheduler.hpp
 
 #include "main_utils.hpp"
 
@@ -266,6 +273,676 @@ void testSequencialQueueReuse()
 }
 
 
+/** Same as testSequencialQueue, but each worker keeps its own thread for
+  * all the jobs instead of launching a new thread per job
+  */
+void testPoolQueue()
+{
+    std::cout << "########################## Demo testPoolQueue ##########################" << std::endl;
+
+    const int in_max = 10;
+    const int nb_workers = 3;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{1, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);  // The worker threads are launched here
+
+    queue.launch(FeederTest(in_max));
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+}
+
+
+/** The workers receive the inputs by batch of at most 4 inputs. The order of
+  * the popped values is kept
+  */
+void testBatchQueue()
+{
+    std::cout << "########################## Demo testBatchQueue ##########################" << std::endl;
+
+    const int in_max = 10;
+    const int nb_workers = 2;
+
+    job_scheduler::QueueScheduler<WorkerBatchTest> queue{10};  // The input queue need to contains enough values to fill the batches
+    queue.add_workers({}, nb_workers);
+    queue.set_batching(4, std::chrono::milliseconds(10));  // Wait at most 10ms for a batch to be filled
+
+    queue.launch(FeederTest(in_max));
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+}
+
+
+/** Print the runtime metrics of the scheduler (only recorded if compiled with
+  * JS_ENABLE_STATS)
+  */
+void testStats()
+{
+    std::cout << "########################## Demo testStats ##########################" << std::endl;
+
+    const int in_max = 20;
+    const int nb_workers = 3;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{};
+    queue.add_workers({"Shared message"}, nb_workers);
+
+    queue.launch(FeederTest(in_max));
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+    }
+    queue.stats().print(std::cout);
+}
+
+
+/** Save the timeline of the jobs in job_trace.json (can be opened with
+  * chrome://tracing or https://ui.perfetto.dev)
+  */
+void testTrace()
+{
+    std::cout << "########################## Demo testTrace ##########################" << std::endl;
+
+    const int in_max = 20;
+    const int nb_workers = 3;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{1, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({"Shared message"}, nb_workers);
+    queue.enable_tracing(100);
+
+    queue.launch(FeederTest(in_max));
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+    }
+
+    std::ofstream file("job_trace.json");
+    queue.write_trace(file);
+    std::cout << "Timeline saved in job_trace.json" << std::endl;
+}
+
+
+/** The batch feeder fills several inputs per call and reports the end of the
+  * stream (or an error) with its return status instead of an exception
+  */
+void testBatchFeeder()
+{
+    std::cout << "########################## Demo testBatchFeeder ##########################" << std::endl;
+
+    const int in_max = 10;
+    const int nb_workers = 2;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{4};  // At most 4 inputs per feeder call
+    queue.add_workers({}, nb_workers);
+
+    int counter = 0;
+    queue.launch([&counter, in_max](std::vector<std::unique_ptr<int>>& inputs, size_t maxInputs) {
+        while (inputs.size() < maxInputs && counter < in_max)
+        {
+            inputs.emplace_back(new int(counter++));
+        }
+        return counter < in_max ? job_scheduler::FeedStatus::MORE : job_scheduler::FeedStatus::ERROR;  // Simulate a read error at the end
+    });
+
+    try
+    {
+        while(std::unique_ptr<std::string> out = queue.pop())
+        {
+            std::cout << "Popped value: " << *out << std::endl;
+        }
+    }
+    catch (const job_scheduler::FeederError& e)
+    {
+        std::cout << "Feeder error: " << e.what() << std::endl;
+        queue.pop();  // Release token
+    }
+}
+
+
+/** The chunks of the source are produced concurrently by several feeder
+  * threads (ex: decoding), but the outputs keep the source order
+  */
+void testParallelFeeder()
+{
+    std::cout << "########################## Demo testParallelFeeder ##########################" << std::endl;
+
+    const int in_max = 10;
+    const int chunk_size = 3;
+    const int nb_workers = 2;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{};
+    queue.add_workers({}, nb_workers);
+    queue.set_feeder_threads(3);
+
+    queue.launch([in_max, chunk_size](size_t chunk, std::vector<std::unique_ptr<int>>& inputs) {  // Called concurrently
+        int begin = static_cast<int>(chunk) * chunk_size;
+        for (int i = begin ; i < std::min(begin + chunk_size, in_max) ; ++i)
+        {
+            inputs.emplace_back(new int(i));
+        }
+        return begin + chunk_size < in_max ? job_scheduler::FeedStatus::MORE : job_scheduler::FeedStatus::END;
+    });
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+}
+
+
+/** The records of a file are given to the workers as views into its memory
+  * mapping (no copy)
+  */
+struct RecordPrinter
+{
+    std::unique_ptr<std::string> operator()(const job_scheduler::RecordView& record) const
+    {
+        return std::unique_ptr<std::string>(new std::string(
+            "Record at " + std::to_string(record.offset) + ": " + std::string(record.data, record.size)
+        ));
+    }
+};
+
+void testMappedFeeder()
+{
+    std::cout << "########################## Demo testMappedFeeder ##########################" << std::endl;
+
+    const std::string path = "mapped_feeder_demo.txt";
+    {
+        std::ofstream file(path);
+        file << "frame 0\nframe 1\nframe 2\nframe 3\nframe 4";  // The last delimiter is optional
+    }
+
+    job_scheduler::QueueScheduler<RecordPrinter> queue{2};
+    queue.add_workers({}, 2);
+    queue.launch(job_scheduler::MappedFeeder::delimited(path, '\n'));
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+    std::remove(path.c_str());
+}
+
+
+/** The outputs are written in order by the sink thread (several outputs per
+  * system call) instead of being popped by the main thread
+  */
+struct LineFormatter
+{
+    std::unique_ptr<std::string> operator()(const int& input) const
+    {
+        return std::unique_ptr<std::string>(new std::string("Written line " + std::to_string(input) + "\n"));
+    }
+};
+
+void testOrderedSink()
+{
+    std::cout << "########################## Demo testOrderedSink ##########################" << std::endl;
+
+    const int in_max = 10;
+
+    job_scheduler::QueueScheduler<LineFormatter> queue{4};
+    queue.add_workers({}, 2);
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    job_scheduler::OrderedSink<job_scheduler::QueueScheduler<LineFormatter>> sink{queue, STDOUT_FILENO, {4}};  // At most 4 lines per write
+    sink.wait();
+    std::cout << sink.nb_outputs() << " outputs written in " << sink.nb_writes() << " writes" << std::endl;
+}
+
+
+/** Any class with a std::unique_ptr<Output> operator()(const Input&) can be
+  * used as worker (without WorkerBase) and any callable as feeder. The calls
+  * are resolved at compile time
+  */
+struct Doubler
+{
+    std::unique_ptr<int> operator()(const int& input) const
+    {
+        return std::unique_ptr<int>(new int(2 * input));
+    }
+};
+
+void testStaticWorker()
+{
+    std::cout << "########################## Demo testStaticWorker ##########################" << std::endl;
+
+    const int in_max = 10;
+    const int nb_workers = 2;
+
+    job_scheduler::QueueScheduler<Doubler> queue{1, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);  // Constructed without the worker id
+
+    int counter = 0;
+    queue.launch([counter, in_max]() mutable {
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;  // nullptr when expired
+    });
+
+    while(std::unique_ptr<int> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+}
+
+
+/** The outputs are only ordered among the inputs of the same key (here the
+  * parity of the input), so a slow job does not delay the other key
+  */
+struct SlowOddStart
+{
+    std::unique_ptr<int> operator()(const int& input) const
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(input == 1 ? 200 : 5));  // Input 1 blocks the odd key
+        return std::unique_ptr<int>(new int(input));
+    }
+};
+
+void testKeyedOrdering()
+{
+    std::cout << "########################## Demo testKeyedOrdering ##########################" << std::endl;
+
+    const int in_max = 10;
+    const int nb_workers = 3;
+
+    job_scheduler::QueueScheduler<SlowOddStart> queue{1, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);
+    queue.set_ordering(job_scheduler::OrderingMode::KEYED, [](const int& input) { return static_cast<size_t>(input % 2); });
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    int nb_ahead = 0;  // Even outputs popped before the slow job
+    bool slow_popped = false;
+    while(std::unique_ptr<int> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << " (key " << *out % 2 << ")" << std::endl;
+        slow_popped = slow_popped || *out == 1;
+        if (!slow_popped && *out % 2 == 0)
+        {
+            ++nb_ahead;
+        }
+    }
+    std::cout << nb_ahead << " outputs of the key 0 moved ahead of the slow job of the key 1" << std::endl;
+}
+
+
+/** Two feeders share the same workers. Each one is popped from its own handle
+  * (on its own thread), in the order of its inputs
+  */
+void testMultiStream()
+{
+    std::cout << "########################## Demo testMultiStream ##########################" << std::endl;
+
+    const int in_max = 10;
+    const int nb_workers = 3;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{1, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, nb_workers);
+
+    auto streamA = queue.launch(FeederTest(in_max));
+    auto streamB = queue.launch(FeederTest(in_max));
+
+    auto consumer = [](decltype(streamA) stream) {
+        while(std::unique_ptr<std::string> out = stream.pop())
+        {
+            PrintThread{} << "Stream " << stream.id() << " popped value: " << *out << std::endl;
+        }
+    };
+    std::thread threadA(consumer, streamA);
+    std::thread threadB(consumer, streamB);
+    threadA.join();
+    threadB.join();
+}
+
+
+/** Two stages chained: the outputs of the first one are the inputs of the
+  * second one (without popping them on the main thread)
+  */
+void testPipeline()
+{
+    std::cout << "########################## Demo testPipeline ##########################" << std::endl;
+
+    const int in_max = 10;
+
+    job_scheduler::QueueScheduler<Doubler> doubler{2, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    doubler.add_workers({}, 2);
+    doubler.set_reorder_window(4);  // Backpressure from the next stage
+
+    job_scheduler::QueueScheduler<WorkerTest> printer{2, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    printer.add_workers({}, 2);
+
+    int counter = 0;
+    doubler.launch([&counter, in_max]() {
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+    printer.launch_from(doubler);
+
+    while(std::unique_ptr<std::string> out = printer.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+}
+
+
+/** The consumer can do other work while the outputs are not ready, and pop
+  * all the ready outputs at once
+  */
+void testNonBlockingPop()
+{
+    std::cout << "########################## Demo testNonBlockingPop ##########################" << std::endl;
+
+    const int in_max = 10;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{1, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, 2);
+    queue.launch(FeederTest(in_max));
+
+    std::unique_ptr<std::string> out;
+    int nb_other_work = 0;
+    while (!queue.try_pop(out))  // Not ready yet
+    {
+        ++nb_other_work;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::cout << "Popped value: " << *out << " (after " << nb_other_work << " other works)" << std::endl;
+
+    if (queue.pop_for(out, std::chrono::seconds(1)))
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+
+    std::vector<std::unique_ptr<std::string>> outputs;
+    while (outputs.empty() || outputs.back())  // Until the release token
+    {
+        outputs.clear();
+        size_t nb_popped = queue.pop_batch(outputs, 4);
+        std::cout << "Popped " << nb_popped << " values at once" << std::endl;
+    }
+}
+
+
+/** Worker slower than the feeder: the frames which waited too long are
+  * dropped instead of delaying the next ones
+  */
+struct SlowFrame
+{
+    std::unique_ptr<int> operator()(const int& input) const
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return std::unique_ptr<int>(new int(input));
+    }
+};
+
+void testDeadline()
+{
+    std::cout << "########################## Demo testDeadline ##########################" << std::endl;
+
+    const int in_max = 20;
+
+    job_scheduler::QueueScheduler<SlowFrame> queue{4, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, 1);
+    queue.set_ttl(std::chrono::milliseconds(30));  // Frames not started 30ms after being produced are dropped
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));  // Live source
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    job_scheduler::JobStatus status;
+    int nb_frames = 0;
+    while(true)
+    {
+        std::unique_ptr<int> out = queue.pop(status);
+        if (status == job_scheduler::JobStatus::RELEASED)
+        {
+            break;
+        }
+        if (status == job_scheduler::JobStatus::DROPPED)
+        {
+            std::cout << "Frame " << nb_frames++ << " dropped" << std::endl;
+        }
+        else
+        {
+            std::cout << "Frame " << nb_frames++ << " popped: " << *out << std::endl;
+        }
+    }
+    std::cout << queue.nb_dropped() << " frames dropped" << std::endl;
+}
+
+
+/** A burst of inputs: workers are added while the inputs wait, and retired
+  * once the stream is quiet
+  */
+void testAutoscaling()
+{
+    std::cout << "########################## Demo testAutoscaling ##########################" << std::endl;
+
+    const int in_max = 60;
+
+    job_scheduler::QueueScheduler<SlowFrame> queue{8, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, 1);
+    job_scheduler::ScalingPolicy policy{1, 4};  // Between 1 and 4 workers
+    policy.nbSamples = 3;
+    queue.set_autoscaling(policy);
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        if (counter == in_max / 2)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));  // Quiet period between two bursts
+        }
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    while(std::unique_ptr<int> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << " (" << queue.nb_workers() << " workers)" << std::endl;
+    }
+}
+
+
+/** Several bursts separated by quiet periods: the pool grows and shrinks
+  * several times, and the contexts of the retired workers are deleted (their
+  * number stays bounded by the maximum number of workers)
+  */
+void testAutoscalingCycles()
+{
+    std::cout << "########################## Demo testAutoscalingCycles ##########################" << std::endl;
+
+    const int in_max = 120;
+    const int burst_size = 30;
+    const size_t max_workers = 4;
+
+    for (job_scheduler::DispatchMode mode : {job_scheduler::DispatchMode::POOL, job_scheduler::DispatchMode::WORK_STEALING})
+    {
+        job_scheduler::QueueScheduler<SlowFrame> queue{8, job_scheduler::UNLIMITED, mode};
+        queue.add_workers({}, 1);
+        job_scheduler::ScalingPolicy policy{1, max_workers};
+        policy.nbSamples = 3;
+        queue.set_autoscaling(policy);
+
+        int counter = 0;
+        queue.launch([&counter, in_max, burst_size]() {
+            if (counter > 0 && counter % burst_size == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));  // Quiet period: back to a single worker
+            }
+            return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+        });
+
+        size_t peak_workers = 0;
+        size_t peak_contexts = 0;
+        while(std::unique_ptr<int> out = queue.pop())
+        {
+            peak_workers = std::max(peak_workers, queue.nb_workers());
+            peak_contexts = std::max(peak_contexts, queue.nb_worker_contexts());
+        }
+        std::cout << "Peak of " << peak_workers << " workers and " << peak_contexts << " contexts over "
+                  << in_max / burst_size << " bursts (" << (peak_contexts <= max_workers + 1 ? "bounded" : "LEAKED") << ")" << std::endl;
+    }
+}
+
+
+/** Heterogeneous workers: the device 0 is 5 times faster than the other ones
+  */
+struct Device
+{
+    Device(int id) : id(id) {}
+
+    std::unique_ptr<std::string> operator()(const int& input) const
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(id == 0 ? 2 : 10));
+        return std::unique_ptr<std::string>(new std::string(std::to_string(input) + " on device " + std::to_string(id)));
+    }
+
+    int id;
+};
+
+void testRouting()
+{
+    std::cout << "########################## Demo testRouting ##########################" << std::endl;
+
+    const int in_max = 20;
+
+    job_scheduler::QueueScheduler<Device> queue{4, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, 3);
+    queue.set_routing(job_scheduler::RoutingPolicy{true, 2.0});  // Fastest idle device, or wait for a busy device twice faster
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+    std::cout << queue.nb_held_back() << " jobs waited for a faster device" << std::endl;
+}
+
+
+/** The device 0 is sometimes throttled, so its job becomes a straggler which
+  * blocks the ordered output
+  */
+struct ThrottledDevice
+{
+    ThrottledDevice(int id) : id(id) {}
+
+    std::unique_ptr<int> operator()(const int& input) const
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(id == 0 && input % 10 == 5 ? 200 : 5));
+        return std::unique_ptr<int>(new int(input));
+    }
+
+    int id;
+};
+
+void testHedging()
+{
+    std::cout << "########################## Demo testHedging ##########################" << std::endl;
+
+    const int in_max = 40;
+
+    job_scheduler::QueueScheduler<ThrottledDevice> queue{4, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.add_workers({}, 3);
+    queue.set_hedging(job_scheduler::HedgingPolicy{0.9, 5});  // Re-execute the jobs slower than 90% of the previous ones
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    while(std::unique_ptr<int> out = queue.pop())
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "Popped value: " << *out << " after " << elapsed.count() << "ms" << std::endl;
+    }
+    std::cout << queue.nb_hedged() << " jobs re-executed, " << queue.nb_hedges_won() << " finished first" << std::endl;
+}
+
+
+struct PinnedWorker
+{
+    PinnedWorker(int id) : id(id), scratch(1024 * 1024, 0) {}  // Allocated on the NUMA node of the worker cores
+
+    std::unique_ptr<std::string> operator()(const int& input)
+    {
+        scratch[static_cast<size_t>(input)] = 1;
+        return std::unique_ptr<std::string>(new std::string(
+            std::to_string(input) + " by worker " + std::to_string(id) + " on core " + std::to_string(job_scheduler::current_cpu())
+        ));
+    }
+
+    int id;
+    std::vector<char> scratch;
+};
+
+void testPlacement()
+{
+    std::cout << "########################## Demo testPlacement ##########################" << std::endl;
+
+    const int in_max = 10;
+
+    std::cout << job_scheduler::numa_nodes().size() << " NUMA node(s), " << job_scheduler::allowed_cpus().size() << " core(s)" << std::endl;
+
+    job_scheduler::PlacementPolicy policy = job_scheduler::PlacementPolicy::per_core();  // One core per worker
+    policy.schedulerCpus = {job_scheduler::allowed_cpus().front()};
+
+    job_scheduler::QueueScheduler<PinnedWorker> queue{4, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.set_placement(policy);
+    queue.add_workers({}, 3);
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+}
+
+
+void testWaitStrategy()
+{
+    std::cout << "########################## Demo testWaitStrategy ##########################" << std::endl;
+
+    const int in_max = 10;
+
+    job_scheduler::QueueScheduler<WorkerTest> queue{4, job_scheduler::UNLIMITED, job_scheduler::DispatchMode::POOL};
+    queue.set_wait_policy(job_scheduler::Handoff::JOBS, job_scheduler::WaitPolicy{job_scheduler::WaitStrategy::SPIN_THEN_BLOCK});  // The workers spin a little before sleeping
+    queue.set_wait_policy(job_scheduler::Handoff::OUTPUTS, job_scheduler::WaitPolicy{job_scheduler::WaitStrategy::SPIN_THEN_BLOCK, 5000, 100});
+    queue.add_workers({"Spinning"}, 2);
+
+    int counter = 0;
+    queue.launch([&counter, in_max]() {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        return counter < in_max ? std::unique_ptr<int>(new int(counter++)) : nullptr;
+    });
+
+    while(std::unique_ptr<std::string> out = queue.pop())
+    {
+        std::cout << "Popped value: " << *out << std::endl;
+    }
+}
+
+
 /** Show how to access directly the underlying workers of the
   */
 void testWorkerAccess()
@@ -298,6 +975,26 @@ int main(int argc, char** argv)
     testQueueThreadPush();
     testSequencialQueue();
     testSequencialQueueReuse();
+    testPoolQueue();
+    testBatchQueue();
+    testStats();
+    testTrace();
+    testStaticWorker();
+    testBatchFeeder();
+    testParallelFeeder();
+    testMappedFeeder();
+    testOrderedSink();
+    testKeyedOrdering();
+    testMultiStream();
+    testPipeline();
+    testNonBlockingPop();
+    testDeadline();
+    testAutoscaling();
+    testAutoscalingCycles();
+    testRouting();
+    testHedging();
+    testPlacement();
+    testWaitStrategy();
     testWorkerAccess();
 
     std::cout << "The end" << std::endl;
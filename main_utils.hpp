@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include "workerbase.hpp"
 
@@ -121,6 +122,34 @@ std::ostream& operator<<(std::ostream& os, const WorkerTest& obj)
 }
 
 
+/** Sample worker class processing the inputs by batch
+  * Has to overload process_batch (operator() is still used without batching)
+  */
+class WorkerBatchTest : public job_scheduler::WorkerBase<int, std::string>
+{
+public:
+    WorkerBatchTest(int i) : WorkerBase(i)
+    {}
+
+    std::unique_ptr<std::string> operator()(const int& input) override
+    {
+        return std::unique_ptr<std::string>(new std::string("Worker " + std::to_string(m_worker_id) + ": input=" + std::to_string(input)));
+    }
+
+    std::vector<std::unique_ptr<std::string>> process_batch(const std::vector<const int*>& inputs) override
+    {
+        std::vector<std::unique_ptr<std::string>> outputs;
+        for (const int* input : inputs)
+        {
+            outputs.emplace_back(new std::string(
+                "Worker " + std::to_string(m_worker_id) + ": input=" + std::to_string(*input) + " (batch of " + std::to_string(inputs.size()) + ")"
+            ));
+        }
+        return outputs;
+    }
+};
+
+
 /** Sample feeder class
   * Generate the input values for the workers
   */